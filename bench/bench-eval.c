@@ -0,0 +1,81 @@
+// Measures the evaluator: builtin calls, user-defined function calls, and parse speed for
+// file-sized input. (The examples lean on `if`/`-`/`*`, which the core doesn't ship yet, so the
+// call-heavy workloads here are built from the builtins that exist.)
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "eval.h"
+#include "list.h"
+#include "parser.h"
+#include "value.h"
+
+#include "bench.h"
+
+// Parses a single form, bailing out of the benchmark entirely on failure.
+static KhValue* _parse_form(const char *str) {
+	GError *err = NULL;
+	KhValue *forms = kh_parse_string(str, &err);
+
+	if (!forms) {
+		fprintf(stderr, "parse failed: %s\n", err->message);
+		exit(1);
+	}
+
+	return KH_CELL(forms)->left;
+}
+
+static KhValue* _eval_or_die(KhContext *ctx, KhValue *form) {
+	KhValue *result = kh_eval(ctx, form);
+
+	if (!result) {
+		fprintf(stderr, "eval failed: %s\n", kh_inspect(kh_get_error(ctx)));
+		exit(1);
+	}
+
+	return result;
+}
+
+int main() {
+	KhContext *ctx = kh_context_new();
+
+	// A builtin call with a handful of arguments; this is the floor for any call.
+	KhValue *builtin_call = _parse_form("+ 1 2 3 4 5 6 7 8");
+	BENCH("eval-builtin-call", "calls/s", 1, {
+		_eval_or_die(ctx, builtin_call);
+	});
+
+	// Nested user-defined function calls; exercises argument evaluation, scope creation and the
+	// function-call machinery in `kh_apply`.
+	_eval_or_die(ctx, _parse_form("def add3 (a b c) {+ a b c}"));
+	KhValue *nested_call = _parse_form("add3 (add3 1 2 3) (add3 4 5 6) (add3 7 8 9)");
+	BENCH("eval-nested-calls", "calls/s", 4, {
+		_eval_or_die(ctx, nested_call);
+	});
+
+	// `let` with a body; exercises scope push/pop and symbol lookup.
+	KhValue *let_form = _parse_form("let ((x 1) (y 2)) {+ x y}");
+	BENCH("eval-let", "evals/s", 1, {
+		_eval_or_die(ctx, let_form);
+	});
+
+	// Whole-pipeline parse of file-sized input (no image cache involved, as this goes through
+	// `kh_parse_string_full`).
+	GString *source = g_string_new("");
+	for (int i = 0; i < 500; i++) {
+		g_string_append(source, "def add3 (a b c) {+ a b c}\n");
+		g_string_append(source, "add3 (add3 1 2 3) (add3 4 5 6) (add3 7 8 9)\n");
+	}
+	double megabytes = source->len / 1e6;
+
+	BENCH("parse-throughput", "MB/s", megabytes, {
+		GError *err = NULL;
+		if (!kh_parse_string_full(source->str, KH_PARSE_ARENA_CELLS, &err)) {
+			fprintf(stderr, "parse failed: %s\n", err->message);
+			return 1;
+		}
+	});
+
+	return 0;
+}
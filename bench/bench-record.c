@@ -0,0 +1,51 @@
+// Measures record field access, both by key and through precomputed slot indices.
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "eval.h"
+#include "record.h"
+#include "value.h"
+
+#include "bench.h"
+
+#define OPS_PER_ITER 1000
+
+int main() {
+	// The context is only needed to initialize the runtime (nil, builtins).
+	kh_context_new();
+
+	const char *keys[] = {"x", "y", "z", "name", "weight", NULL};
+	KhValue *type = kh_record_type_new(keys);
+
+	KhValue *values[] = {kh_int_new(1), kh_int_new(2), kh_int_new(3), kh_string_new("a"), kh_int_new(70)};
+	KhRecord *record = KH_RECORD(kh_record_new_from_values(KH_RECORD_TYPE(type), values));
+
+	BENCH("record-get-by-key", "gets/s", OPS_PER_ITER, {
+		for (int i = 0; i < OPS_PER_ITER; i++) {
+			kh_record_get(record, "weight");
+		}
+	});
+
+	BENCH("record-set-by-key", "sets/s", OPS_PER_ITER, {
+		for (int i = 0; i < OPS_PER_ITER; i++) {
+			kh_record_set(record, "weight", values[4]);
+		}
+	});
+
+	long index = kh_record_type_key_index(KH_RECORD_TYPE(type), "weight");
+
+	BENCH("record-get-indexed", "gets/s", OPS_PER_ITER, {
+		for (int i = 0; i < OPS_PER_ITER; i++) {
+			kh_record_get_indexed(record, index);
+		}
+	});
+
+	BENCH("record-set-indexed", "sets/s", OPS_PER_ITER, {
+		for (int i = 0; i < OPS_PER_ITER; i++) {
+			kh_record_set_indexed(record, index, values[4]);
+		}
+	});
+
+	return 0;
+}
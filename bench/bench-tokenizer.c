@@ -0,0 +1,40 @@
+// Measures raw tokenizer throughput over an in-memory buffer, independent of the parser and
+// evaluator above it.
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "tokenizer.h"
+
+int main() {
+	// A line using most of the token types, repeated until the input is big enough that per-call
+	// overhead disappears into the noise.
+	GString *source = g_string_new("");
+	for (int i = 0; i < 2000; i++) {
+		g_string_append(source, "def fact (n) { if [n < 2] 1 [n * (fact [n - 1])] }\n");
+		g_string_append(source, "print \"so far:\" (fact 10), inspect '(a b c)\n");
+	}
+
+	double megabytes = source->len / 1e6;
+
+	BENCH("tokenize-throughput", "MB/s", megabytes, {
+		GError *err = NULL;
+		KhTokenizer *tokenizer = kh_tokenizer_new_from_string(source->str, &err);
+		if (!tokenizer) {
+			fprintf(stderr, "tokenizer setup failed: %s\n", err->message);
+			return 1;
+		}
+
+		KhToken token = KH_TOKEN_EMPTY;
+		while (kh_tokenizer_next(tokenizer, &token, &err) && token.type != T_EOF);
+
+		if (err) {
+			fprintf(stderr, "tokenize failed: %s\n", err->message);
+			return 1;
+		}
+	});
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <glib.h>
+#include <stdio.h>
+
+// Common scaffolding for the benchmark programs under `bench/`.
+//
+// Each benchmark repeats its body until at least a second has elapsed, then prints a single
+// machine-readable line:
+//
+//     <name>\t<rate>\t<unit>
+//
+// Rates rather than times, so bigger is always better and results are comparable regardless of how
+// many iterations happened to fit. `per_iter` is how many units one execution of the body is worth
+// (bytes tokenized, calls evaluated, and so on).
+#define BENCH(name, unit, per_iter, block) do { \
+	gint64 _start = g_get_monotonic_time(); \
+	gint64 _elapsed; \
+	long _iters = 0; \
+	do { \
+		block; \
+		_iters++; \
+		_elapsed = g_get_monotonic_time() - _start; \
+	} while (_elapsed < 1000000); \
+	printf("%s\t%.1f\t%s\n", name, ((double) _iters * (per_iter)) / ((double) _elapsed / 1e6), unit); \
+} while (0)
+
+#endif
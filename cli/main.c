@@ -1,6 +1,7 @@
 // # Headers
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "eval.c"
 #include "list.h"
@@ -14,12 +15,69 @@ int main(int argc, char **argv) {
 	// interpreter lives.
 	KhContext *ctx = kh_context_new();
 
+	// ## Option parsing
+	// Options come before the filename. `--stream` is explained below; `--profile` turns on the
+	// per-function profiler and dumps its table to stderr when the program finishes.
+	int argi = 1;
+	bool stream = false, profile = false;
+	for (; argi < argc && argv[argi][0] == '-'; argi++) {
+		if (strcmp(argv[argi], "--stream") == 0) {
+			stream = true;
+		} else if (strcmp(argv[argi], "--profile") == 0) {
+			profile = true;
+		} else {
+			fprintf(stderr, "Unknown option: %s\n", argv[argi]);
+			return 2;
+		}
+	}
+
+	if (profile) kh_context_set_profiling(ctx, true);
+
+	// ## Streaming execution
+	// With `--stream`, each top-level form is evaluated as soon as it parses instead of the whole
+	// program being materialized first, so forms that have already run can be collected while later
+	// ones are still being parsed. (No cell arena here; a slab would pin dead forms alongside live
+	// ones.)
+	if (stream && argi < argc) {
+		GError *err = NULL;
+		KhParser *parser = kh_parser_new(argv[argi], KH_PARSE_DEFAULT, &err);
+
+		if (!parser) {
+			fprintf(stderr, "Parse error: %s\n", err->message);
+			return 1;
+		}
+
+		KhValue *form;
+		while (kh_parse_next_form(parser, &form, &err)) {
+			// NULL with no error means end of input.
+			if (!form) {
+				if (profile) kh_profile_report(ctx, stderr);
+				return 0;
+			}
+
+			if (!kh_eval(ctx, form)) {
+				KhWriter writer = kh_file_writer(stderr);
+				fputs("Error: ", stderr);
+				kh_inspect_to(kh_get_error(ctx), &writer);
+				fputc('\n', stderr);
+				return 1;
+			}
+
+			// Between forms is the best place to absorb collection work, rather than mid-form.
+			GC_collect_a_little();
+		}
+
+		fprintf(stderr, "Parse error: %s\n", err->message);
+		return 1;
+	}
+
 	// ## File execution
-	// Check for a filename as the first argument.
-	if (argc > 1) {
-		// Parse our file into a list of lists (assumed to be an open list).
+	// Check for a filename after any options.
+	if (argi < argc) {
+		// Parse our file into a list of lists (assumed to be an open list). Whole files are big
+		// enough that arena-allocating the cells and folding constants are worthwhile.
 		GError *err = NULL;
-		KhValue *forms = kh_parse_file(argv[1], &err);
+		KhValue *forms = kh_parse_file_full(argv[argi], KH_PARSE_ARENA_CELLS | KH_PARSE_FOLD_CONSTANTS, &err);
 
 		if (!forms) {
 			fprintf(stderr, "Parse error: %s\n", err->message);
@@ -30,11 +88,21 @@ int main(int argc, char **argv) {
 			KhValue *value = kh_eval(ctx, elem);
 
 			if (value == NULL) {
-				fprintf(stderr, "Error: %s\n", kh_inspect(kh_get_error(ctx)));
+				// Stream the error straight to stderr; inspecting into a string first would mean a
+				// full in-memory copy of what may be a large structure.
+				KhWriter writer = kh_file_writer(stderr);
+				fputs("Error: ", stderr);
+				kh_inspect_to(kh_get_error(ctx), &writer);
+				fputc('\n', stderr);
 				return 1;
 			}
+
+			// Between forms is the best place to absorb collection work, rather than mid-form.
+			GC_collect_a_little();
 		}
 
+		if (profile) kh_profile_report(ctx, stderr);
+
 		return 0;
 	}
 
@@ -64,15 +132,21 @@ int main(int argc, char **argv) {
 
 		// Finally, run each form, checking for errors, and print out the result.
 		int i = 1;
+		KhWriter writer = kh_file_writer(stdout);
 		KH_ITERATE(forms) {
 			KhValue *value = kh_eval(ctx, elem);
 
 			if (value == NULL) {
-				printf("Error: %s\n", kh_inspect(kh_get_error(ctx)));
+				fputs("Error: ", stdout);
+				kh_inspect_to(kh_get_error(ctx), &writer);
+				putchar('\n');
 			} else {
 				if (print_number) printf("%d. ", i++);
 				// If we run only a single form and it returns nil, don't bother printing it.
-				if (print_number || value != kh_nil) puts(kh_inspect(value));
+				if (print_number || value != kh_nil) {
+					kh_inspect_to(value, &writer);
+					putchar('\n');
+				}
 			}
 		}
 	}
@@ -27,7 +27,9 @@
 
 #include "eval.h"
 #include "list.h"
+#include "map.h"
 #include "record.h"
+#include "seq.h"
 #include "util.h"
 #include "value.h"
 
@@ -61,12 +63,20 @@ static KhValue* _create_func(KhContext *ctx, const gchar *name, KhValue *arg_des
 // # Builtin definitions
 // ## `+` - add 1 or more integers
 //
-// Takes 1 or more integer arguments and returns their sum.
+// Takes 1 or more integer arguments and returns their sum. The typed implementation is what runs
+// on all-int calls (which is to say, nearly all of them); the generic one only remains as the
+// fallback for mixed arguments.
+static long add_longs(long left, long right) {
+	return left + right;
+}
+
 static KhValue* add(KhContext *ctx, long argc, KhValue **argv) {
-	int result = 0;
+	long result = 0;
 
-	for (int i = 0; i < argc; i++) {
-		result += KH_INT(argv[i])->value;
+	for (long i = 0; i < argc; i++) {
+		KH_FAIL_UNLESS(KH_IS_INT(argv[i]), bad-type, "+ requires ints, got %s", kh_inspect(argv[i]));
+
+		result += KH_INT_VALUE(argv[i]);
 	}
 
 	return kh_int_new(result);
@@ -168,6 +178,26 @@ static KhValue* first(KhContext *ctx, long argc, KhValue **argv) {
 	return KH_CELL(argv[0])->left;
 }
 
+// ## `gc-stats` - returns collector statistics
+//
+// Returns an association list of collector statistics: collection count, heap and free bytes, and
+// cumulative/worst-case pause times in microseconds. The heap is process-wide, so these are too.
+static KhValue* gc_stats(KhContext *ctx, long argc, KhValue **argv) {
+	KhGcStats stats;
+	kh_gc_get_stats(&stats);
+
+	KhValue *result = kh_nil;
+#define _STAT(name, value) result = kh_list_prepend(result, kh_cell_new(kh_symbol_new(name), kh_cell_new(kh_int_new(value), kh_nil)))
+	_STAT("max-pause-usec", stats.max_pause_usec);
+	_STAT("total-pause-usec", stats.total_pause_usec);
+	_STAT("free-bytes", stats.free_bytes);
+	_STAT("heap-size", stats.heap_size);
+	_STAT("collections", stats.collections);
+#undef _STAT
+
+	return result;
+}
+
 // ## `get-key` - gets a key from a record
 //
 // Gets a given key in a record.
@@ -190,6 +220,16 @@ static KhValue* inspect(KhContext *ctx, long argc, KhValue **argv) {
 	return kh_string_new_take(kh_inspect(argv[0]));
 }
 
+// ## `import` - loads another file as a module
+//
+// Takes a path to a Scarab file; its top-level definitions become available here, but only run
+// when first referenced, so importing a large library costs nothing for the parts never used.
+static KhValue* import(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_STRING(argv[0]), bad-type, "import requires a path string, got %s", kh_inspect(argv[0]));
+
+	return kh_context_import(ctx, KH_STRING(argv[0])->value);
+}
+
 // ## `lambda` - define an inline function
 //
 // Same as def, but returns the function value instead of adding it to the symbol table.
@@ -241,15 +281,201 @@ static KhValue* make(KhContext *ctx, long argc, KhValue **argv) {
 	return kh_record_new_from_values(type, values);
 }
 
+// ## `map` - creates a hash map
+//
+// Creates a new map from the given alternating keys and values. Unlike a record, a map has no
+// fixed key set; keys can be added freely after creation with `map-set`, and every access is a
+// hash lookup rather than a list walk.
+
+// Map keys can be given as either symbols or strings; either way they end up interned.
+static const char* _map_key(KhValue *key) {
+	if (KH_IS_SYMBOL(key)) return KH_SYMBOL(key)->value;
+	if (KH_IS_STRING(key)) return KH_STRING(key)->value;
+
+	return NULL;
+}
+
+static KhValue* map(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(argc % 2 == 0, bad-args, "map requires an even number of arguments, got %ld", argc);
+
+	KhValue *result = kh_map_new();
+
+	for (long i = 0; i < argc; i += 2) {
+		const char *key = _map_key(argv[i]);
+		KH_FAIL_UNLESS(key, bad-type, "map requires symbol or string keys, got %s", kh_inspect(argv[i]));
+
+		kh_map_set(KH_MAP(result), key, argv[i + 1]);
+	}
+
+	return result;
+}
+
+// ## `map-each` - calls a function for each pair in a map
+//
+// Calls the given function with each key (as a symbol) and value in the map, in no particular
+// order, and returns the map. Adding keys to the map while it is being iterated is not supported.
+typedef struct {
+	KhContext *ctx;
+	KhFunc *func;
+	bool failed;
+} _MapEachState;
+
+static bool _map_each_cb(const char *key, KhValue *value, void *userdata) {
+	_MapEachState *state = (_MapEachState*) userdata;
+
+	KhValue *call_argv[] = { kh_symbol_new(key), value };
+	if (!kh_apply_values(state->ctx, state->func, 2, call_argv)) {
+		state->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+static KhValue* map_each(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_MAP(argv[0]), bad-type, "map-each requires a map, got %s", kh_inspect(argv[0]));
+	KH_FAIL_UNLESS(KH_IS_FUNC(argv[1]), bad-type, "map-each requires a function, got %s", kh_inspect(argv[1]));
+
+	_MapEachState state = { ctx, KH_FUNC(argv[1]), false };
+	kh_map_foreach(KH_MAP(argv[0]), _map_each_cb, &state);
+
+	// The error from the failed call is already pending on the context.
+	if (state.failed) return NULL;
+
+	return argv[0];
+}
+
+// ## `map-get` - gets a key from a map
+//
+// Gets the value for a key in a map; it is an error if the key is not set.
+static KhValue* map_get(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_MAP(argv[0]), bad-type, "map-get requires a map, got %s", kh_inspect(argv[0]));
+
+	const char *key = _map_key(argv[1]);
+	KH_FAIL_UNLESS(key, bad-type, "map-get requires a symbol or string key, got %s", kh_inspect(argv[1]));
+
+	KhValue *value = kh_map_get(KH_MAP(argv[0]), key);
+	KH_FAIL_UNLESS(value, unknown-key, "No such key %s in map", key);
+
+	return value;
+}
+
+// ## `map-set` - sets a key in a map
+//
+// Sets the value for a key in a map (in place, adding the key if needed), and returns the map.
+static KhValue* map_set(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_MAP(argv[0]), bad-type, "map-set requires a map, got %s", kh_inspect(argv[0]));
+
+	const char *key = _map_key(argv[1]);
+	KH_FAIL_UNLESS(key, bad-type, "map-set requires a symbol or string key, got %s", kh_inspect(argv[1]));
+
+	kh_map_set(KH_MAP(argv[0]), key, argv[2]);
+
+	return argv[0];
+}
+
+// ## `parallel-map` - maps a function over a list using a pool of threads
+//
+// Takes a function and a list, and returns a new list holding the function's result for each
+// element. The work is split over one worker per core, each with its own context forked from the
+// caller's (so globals and methods are visible), but the function must be pure: it can read its
+// enclosing scopes, but writes to anything shared are unsynchronized.
+typedef struct {
+	KhContext *base_ctx;
+	KhFunc *func;
+	KhValue **values;
+	long start;
+	long end;
+
+	KhValue *error;
+} _ParallelMapChunk;
+
+static gpointer _parallel_map_worker(gpointer data) {
+	_ParallelMapChunk *chunk = data;
+
+	// GLib threads are invisible to the Boehm GC until they register; without this, allocations
+	// below could be collected out from under us (or crash outright).
+	struct GC_stack_base stack_base;
+	GC_get_stack_base(&stack_base);
+	GC_register_my_thread(&stack_base);
+
+	// A fork shares the caller's definitions read-only; see `kh_context_fork`.
+	KhContext *ctx = kh_context_fork(chunk->base_ctx);
+
+	for (long i = chunk->start; i < chunk->end; i++) {
+		KhValue *result = kh_apply_values(ctx, chunk->func, 1, &chunk->values[i]);
+
+		if (!result) {
+			chunk->error = kh_get_error(ctx);
+			break;
+		}
+
+		// Results are written in place, so no per-chunk result storage is needed.
+		chunk->values[i] = result;
+	}
+
+	GC_unregister_my_thread();
+
+	return NULL;
+}
+
+static KhValue* parallel_map(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_FUNC(argv[0]), not-func, "parallel-map requires a function, got %s", kh_inspect(argv[0]));
+
+	long length = kh_list_length(argv[1]);
+	if (length == 0) return kh_nil;
+
+	KhValue **values = GC_MALLOC(sizeof(KhValue*) * length);
+	long i = 0;
+	KH_ITERATE(argv[1]) values[i++] = elem;
+
+	long num_workers = MIN((long) g_get_num_processors(), length);
+	_ParallelMapChunk chunks[num_workers];
+	GThread *threads[num_workers];
+
+	for (long w = 0; w < num_workers; w++) {
+		chunks[w] = (_ParallelMapChunk) {
+			.base_ctx = ctx,
+			.func = KH_FUNC(argv[0]),
+			.values = values,
+			.start = length * w / num_workers,
+			.end = length * (w + 1) / num_workers,
+		};
+		threads[w] = g_thread_new("parallel-map", _parallel_map_worker, &chunks[w]);
+	}
+
+	KhValue *error = NULL;
+	for (long w = 0; w < num_workers; w++) {
+		g_thread_join(threads[w]);
+
+		// Every worker runs to completion regardless; the first error (in list order) wins.
+		if (chunks[w].error && !error) error = chunks[w].error;
+	}
+
+	if (error) {
+		kh_set_error(ctx, error);
+		return NULL;
+	}
+
+	KhValue *result = kh_nil;
+	for (long j = length - 1; j >= 0; j--) result = kh_list_prepend(result, values[j]);
+
+	return result;
+}
+
 // ## `print` - prints values to the console
 //
 // Prints all arguments to the screen (after string conversion), separated with spaces and
 // terminated with a space.
 static KhValue* print(KhContext *ctx, long argc, KhValue **argv) {
+	KhWriter writer = kh_file_writer(stdout);
+
 	for (long i = 0; i < argc; i++) {
 		// TODO: Make to-string again once bindings are ready
-		char *str = kh_inspect(argv[i]);
-		fputs(str, stdout);
+		//
+		// Writing straight to stdout means no in-memory copy of the rendering, no matter how large
+		// the value.
+		kh_inspect_to(argv[i], &writer);
 		if (i != argc - 1) putchar(' ');
 	}
 
@@ -258,6 +484,16 @@ static KhValue* print(KhContext *ctx, long argc, KhValue **argv) {
 	return kh_nil;
 }
 
+// ## `profile-report` - prints the profiler's per-function table
+//
+// Dumps call counts and inclusive/exclusive times for every profiled function, sorted by
+// inclusive time. Prints nothing if profiling was never enabled on this context.
+static KhValue* profile_report(KhContext *ctx, long argc, KhValue **argv) {
+	kh_profile_report(ctx, stdout);
+
+	return kh_nil;
+}
+
 // ## `quote` - returns values unevaluated
 static KhValue* quote(KhContext *ctx, long argc, KhValue **argv) {
 	return argv[0];
@@ -283,11 +519,161 @@ static KhValue* rest(KhContext *ctx, long argc, KhValue **argv) {
 	return KH_IS_CELL(argv[0]) ? KH_CELL(argv[0])->right : kh_nil;
 }
 
+// ## `seq` - creates a lazy sequence from a list
+//
+// Returns a sequence producing the list's elements one at a time; a sequence passed in is
+// returned as-is, so pipeline stages can accept either.
+static KhValue* seq(KhContext *ctx, long argc, KhValue **argv) {
+	if (KH_IS_SEQ(argv[0])) return argv[0];
+
+	KH_FAIL_UNLESS(KH_IS_CELL(argv[0]) || KH_IS_NIL(argv[0]), bad-type, "seq requires a list, got %s", kh_inspect(argv[0]));
+
+	return kh_seq_from_list(argv[0]);
+}
+
+// ## `seq-filter` - lazily filters a sequence
+//
+// Returns a sequence of the elements for which the function returns a non-nil value. The function
+// is only called as the result is pulled from.
+static KhValue* seq_filter(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_FUNC(argv[0]), bad-type, "seq-filter requires a function, got %s", kh_inspect(argv[0]));
+	KH_FAIL_UNLESS(KH_IS_SEQ(argv[1]), bad-type, "seq-filter requires a sequence, got %s", kh_inspect(argv[1]));
+
+	return kh_seq_filter(KH_SEQ(argv[1]), KH_FUNC(argv[0]));
+}
+
+// ## `seq-map` - lazily maps a function over a sequence
+//
+// As `seq-filter`, but producing the function's result for each element.
+static KhValue* seq_map(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_FUNC(argv[0]), bad-type, "seq-map requires a function, got %s", kh_inspect(argv[0]));
+	KH_FAIL_UNLESS(KH_IS_SEQ(argv[1]), bad-type, "seq-map requires a sequence, got %s", kh_inspect(argv[1]));
+
+	return kh_seq_map(KH_SEQ(argv[1]), KH_FUNC(argv[0]));
+}
+
+// ## `seq-next` - pulls the next element from a sequence
+//
+// Returns the next element, or nil once the sequence is exhausted. (A sequence of nils is thus
+// indistinguishable from the end; use `seq-filter` first if that matters.)
+static KhValue* seq_next(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_SEQ(argv[0]), bad-type, "seq-next requires a sequence, got %s", kh_inspect(argv[0]));
+
+	KhValue *value;
+	if (!kh_seq_next(ctx, KH_SEQ(argv[0]), &value)) return NULL;
+
+	return value ? value : kh_nil;
+}
+
+// ## `seq-range` - a sequence of consecutive integers
+//
+// Yields the integers from the first argument (inclusive) to the second (exclusive), without ever
+// materializing them as a list.
+static KhValue* seq_range(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_INT(argv[0]) && KH_IS_INT(argv[1]), bad-type, "seq-range requires two ints, got %s", kh_inspect(KH_IS_INT(argv[0]) ? argv[1] : argv[0]));
+
+	return kh_seq_range(KH_INT_VALUE(argv[0]), KH_INT_VALUE(argv[1]));
+}
+
+// ## `seq-take` - lazily limits a sequence
+//
+// Returns a sequence of at most the first n elements; once the limit is hit, the source is never
+// pulled again, so nothing past it is computed.
+static KhValue* seq_take(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_INT(argv[0]), bad-type, "seq-take requires an int, got %s", kh_inspect(argv[0]));
+	KH_FAIL_UNLESS(KH_IS_SEQ(argv[1]), bad-type, "seq-take requires a sequence, got %s", kh_inspect(argv[1]));
+
+	return kh_seq_take(KH_SEQ(argv[1]), KH_INT_VALUE(argv[0]));
+}
+
+// ## `seq-to-list` - materializes a sequence
+//
+// Pulls the sequence to exhaustion and returns its elements as a list. This is the eager end of a
+// pipeline; everything before it still runs one element at a time.
+static KhValue* seq_to_list(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_SEQ(argv[0]), bad-type, "seq-to-list requires a sequence, got %s", kh_inspect(argv[0]));
+
+	KhListBuilder builder;
+	kh_list_builder_init(&builder, NULL);
+
+	KhValue *value;
+	while (true) {
+		if (!kh_seq_next(ctx, KH_SEQ(argv[0]), &value)) return NULL;
+		if (!value) break;
+
+		kh_list_builder_append(&builder, value);
+	}
+
+	return kh_list_builder_finish(&builder);
+}
+
+// ## `string-concat` - concatenates strings
+//
+// Returns the concatenation of the given strings. Built on `kh_string_concat`, so repeatedly
+// concatenating onto a result stays cheap no matter how large it grows.
+static KhValue* string_concat(KhContext *ctx, long argc, KhValue **argv) {
+	KhValue *result = argv[0];
+	KH_FAIL_UNLESS(KH_IS_STRING(result), bad-type, "string-concat requires strings, got %s", kh_inspect(result));
+
+	for (long i = 1; i < argc; i++) {
+		KH_FAIL_UNLESS(KH_IS_STRING(argv[i]), bad-type, "string-concat requires strings, got %s", kh_inspect(argv[i]));
+
+		result = kh_string_concat(KH_STRING(result), KH_STRING(argv[i]));
+	}
+
+	return result;
+}
+
+// ## `string-length` - returns the length of a string in bytes
+static KhValue* string_length(KhContext *ctx, long argc, KhValue **argv) {
+	KH_FAIL_UNLESS(KH_IS_STRING(argv[0]), bad-type, "string-length requires a string, got %s", kh_inspect(argv[0]));
+
+	return kh_int_new(KH_STRING(argv[0])->length);
+}
+
+// ## `vector` - creates a vector
+//
+// Creates a new vector containing the given values.
+static KhValue* vector(KhContext *ctx, long argc, KhValue **argv) {
+	KhValue *result = kh_vector_new(argc);
+
+	for (long i = 0; i < argc; i++) kh_vector_append(KH_VECTOR(result), argv[i]);
+
+	return result;
+}
+
+// ## `vector-append` - appends a value to a vector
+//
+// Appends the given value to the end of the vector (in place), and returns the vector.
+static KhValue* vector_append(KhContext *ctx, long argc, KhValue **argv) {
+	kh_vector_append(KH_VECTOR(argv[0]), argv[1]);
+
+	return argv[0];
+}
+
+// ## `vector-get` - returns the element at an index
+//
+// Returns the element of the vector at the given (0-based) index.
+static KhValue* vector_get(KhContext *ctx, long argc, KhValue **argv) {
+	KhVector *vec = KH_VECTOR(argv[0]);
+	long index = KH_INT_VALUE(argv[1]);
+
+	KH_FAIL_UNLESS(0 <= index && index < vec->length, bad-index, "Index %ld out of range for vector of length %ld", index, vec->length);
+
+	return vec->values[index];
+}
+
+// ## `vector-length` - returns the length of a vector
+static KhValue* vector_length(KhContext *ctx, long argc, KhValue **argv) {
+	return kh_int_new(KH_VECTOR(argv[0])->length);
+}
+
 #define _REG_VARARGS(name, func, min_argc, max_argc, is_direct) kh_scope_add(_builtins_scope, name, kh_func_new_c(#name, func, min_argc, max_argc, is_direct));
 #define _REG(name, func, argc, is_direct) _REG_VARARGS(name, func, argc, argc, is_direct)
+#define _REG_INT(name, func, int_func, min_argc, max_argc) kh_scope_add(_builtins_scope, name, kh_func_new_c_int(#name, func, int_func, min_argc, max_argc));
 
 void _register_builtins(KhScope *_builtins_scope) {
-	_REG_VARARGS("+", add, 1, LONG_MAX, false);
+	_REG_INT("+", add, add_longs, 1, LONG_MAX);
 	_REG("=", set, 2, true);
 	_REG_VARARGS("@", call_method, 2, LONG_MAX, true);
 	_REG("atom?", atom, 1, false);
@@ -296,16 +682,37 @@ void _register_builtins(KhScope *_builtins_scope) {
 	_REG("def-method", def_method, 3, true);
 	_REG("eval", eval, 1, false);
 	_REG("first", first, 1, false);
+	_REG("gc-stats", gc_stats, 0, false);
 	_REG("get-key", get_key, 2, true);
+	_REG("import", import, 1, false);
 	_REG("inspect", inspect, 1, false);
 	_REG("inspect-direct", inspect, 1, true);
 	_REG("lambda", lambda, 2, true);
 	_REG("let", let, 2, true);
 	_REG_VARARGS("make", make, 1, LONG_MAX, false);
+	_REG_VARARGS("map", map, 0, LONG_MAX, false);
+	_REG("map-each", map_each, 2, false);
+	_REG("map-get", map_get, 2, false);
+	_REG("map-set", map_set, 3, false);
+	_REG("parallel-map", parallel_map, 2, false);
 	_REG_VARARGS("print", print, 0, LONG_MAX, false);
+	_REG("profile-report", profile_report, 0, false);
 	_REG("quote", quote, 1, true);
 	_REG("record-type", record_type, 2, true);
 	_REG("rest", rest, 1, false);
+	_REG("seq", seq, 1, false);
+	_REG("seq-filter", seq_filter, 2, false);
+	_REG("seq-map", seq_map, 2, false);
+	_REG("seq-next", seq_next, 1, false);
+	_REG("seq-range", seq_range, 2, false);
+	_REG("seq-take", seq_take, 2, false);
+	_REG("seq-to-list", seq_to_list, 1, false);
+	_REG_VARARGS("string-concat", string_concat, 1, LONG_MAX, false);
+	_REG("string-length", string_length, 1, false);
+	_REG_VARARGS("vector", vector, 0, LONG_MAX, false);
+	_REG("vector-append", vector_append, 2, false);
+	_REG("vector-get", vector_get, 2, false);
+	_REG("vector-length", vector_length, 1, false);
 }
 
 // # Builtin methods
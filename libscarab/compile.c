@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2015 Jesse Weaver <pianohacker@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// This is the bytecode compiler and VM that back `kh_eval`. Rather than re-walking the cons-cell
+// tree of a form on every evaluation, we lower each form once into a flat array of instructions
+// and run those in a simple dispatch loop.
+//
+// One wrinkle keeps this from being a textbook stack compiler: whether a call's arguments are
+// evaluated depends on the function being called (direct functions receive their arguments
+// unevaluated), and the head of a form is not resolved until runtime. So each call compiles to a
+// call site that keeps both the raw argument forms and a compiled fragment per argument, and the
+// VM picks which to use once it has the function in hand.
+
+#include <gc.h>
+#include <glib.h>
+#include <stdbool.h>
+
+#include "compile.h"
+#include "eval.h"
+#include "list.h"
+#include "symbol.h"
+#include "util.h"
+#include "value.h"
+
+extern bool _kh_context_try_tail_call(KhContext *ctx, KhFunc *func, long argc, KhValue **argv, long unwraps);
+
+// # Struct definitions
+
+// The instruction set is tiny; everything interesting is a call.
+typedef enum {
+	// Push a constant onto the value stack.
+	KH_OP_CONST,
+	// Look up a symbol (stored as a constant) in the current scope and push its value.
+	KH_OP_LOOKUP,
+	// Pop the function at the top of the stack and apply it to the arguments of the given call
+	// site, pushing the result.
+	KH_OP_CALL,
+} KhOp;
+
+typedef struct {
+	KhOp op;
+	long arg;
+
+	// For KH_OP_LOOKUP, the lexical address this reference last resolved to; starts zeroed
+	// (unresolved) and is filled in by the first lookup.
+	KhScopeAddr addr;
+} KhInstr;
+
+// Each call site remembers the argument forms both ways: raw for direct functions, compiled for
+// everything else.
+typedef struct {
+	long argc;
+	KhValue **raw_argv;
+	KhCode **arg_code;
+
+	// Whether this call is in tail position of the compiled form. Only acted on when the code is
+	// run as a function body; see `kh_code_run_tail`.
+	bool is_tail;
+} KhCallSite;
+
+struct _KhCode {
+	KhInstr *instrs;
+	long num_instrs;
+
+	KhValue **consts;
+	long num_consts;
+
+	KhCallSite *sites;
+	long num_sites;
+
+	// The deepest the value stack can get while running this code, computed during compilation so
+	// the VM can allocate its stack up front.
+	long max_stack;
+};
+
+// # Compiler
+
+// The growable state for a compilation in progress; everything is moved into the resulting
+// `KhCode` at the end.
+typedef struct {
+	KhInstr *instrs;
+	long num_instrs;
+	long instrs_alloc;
+
+	KhValue **consts;
+	long num_consts;
+	long consts_alloc;
+
+	KhCallSite *sites;
+	long num_sites;
+	long sites_alloc;
+
+	long cur_stack;
+	long max_stack;
+} KhCompiler;
+
+#define _GROW_ARRAY(array, num, alloc, type) if (num == alloc) { \
+		alloc = alloc ? alloc * 2 : 4; \
+		array = GC_REALLOC(array, sizeof(type) * alloc); \
+	}
+
+static void _emit(KhCompiler *c, KhOp op, long arg, long stack_effect) {
+	_GROW_ARRAY(c->instrs, c->num_instrs, c->instrs_alloc, KhInstr);
+
+	c->instrs[c->num_instrs].op = op;
+	c->instrs[c->num_instrs].arg = arg;
+	c->instrs[c->num_instrs].addr = (KhScopeAddr){0};
+	c->num_instrs++;
+
+	c->cur_stack += stack_effect;
+	if (c->cur_stack > c->max_stack) c->max_stack = c->cur_stack;
+}
+
+static long _add_const(KhCompiler *c, KhValue *value) {
+	_GROW_ARRAY(c->consts, c->num_consts, c->consts_alloc, KhValue*);
+
+	c->consts[c->num_consts] = value;
+
+	return c->num_consts++;
+}
+
+// For _add_call_site
+static KhCode* _compile(KhValue *form);
+
+static long _add_call_site(KhCompiler *c, KhValue *args, bool is_tail) {
+	_GROW_ARRAY(c->sites, c->num_sites, c->sites_alloc, KhCallSite);
+
+	KhCallSite *site = &c->sites[c->num_sites];
+	site->argc = 0;
+	site->raw_argv = NULL;
+	site->arg_code = NULL;
+	site->is_tail = is_tail;
+
+	// Collected in a single pass, rather than a length pass followed by a fill pass.
+	long alloc = 0;
+	KH_ITERATE(args) {
+		if (site->argc == alloc) {
+			alloc = alloc ? alloc * 2 : 4;
+			site->raw_argv = GC_REALLOC(site->raw_argv, sizeof(KhValue*) * alloc);
+			site->arg_code = GC_REALLOC(site->arg_code, sizeof(KhCode*) * alloc);
+		}
+
+		site->raw_argv[site->argc] = elem;
+		site->arg_code[site->argc] = _compile(elem);
+		site->argc++;
+	}
+
+	return c->num_sites++;
+}
+
+// This emits the instructions to evaluate a single form, leaving its value on the stack. The
+// cases mirror the ones `kh_eval` used to check on every pass over the tree.
+//
+// `tail` tracks tail position: the outermost call of the form is in tail position, and so is the
+// head of a no-argument call in tail position (since a `(f)`-shaped form just passes the head's
+// value through, or calls it with no arguments if it came out a function).
+static void _compile_form(KhCompiler *c, KhValue *form, bool tail) {
+	if (kh_is_atom(form)) {
+		_emit(c, KH_OP_CONST, _add_const(c, form), 1);
+	} else if (KH_IS_SYMBOL(form)) {
+		_emit(c, KH_OP_LOOKUP, _add_const(c, form), 1);
+	} else if (KH_IS_QUOTED(form)) {
+		_emit(c, KH_OP_CONST, _add_const(c, KH_QUOTED(form)->value), 1);
+	} else {
+		// A call; the head is compiled inline, the arguments into their own fragments at the call
+		// site.
+		KhValue *args = KH_CELL(form)->right;
+
+		_compile_form(c, KH_CELL(form)->left, tail && KH_IS_NIL(args));
+		_emit(c, KH_OP_CALL, _add_call_site(c, args, tail), 0);
+	}
+}
+
+static KhCode* _compile(KhValue *form) {
+	KhCompiler c = {0};
+
+	_compile_form(&c, form, true);
+
+	KhCode *code = GC_NEW(KhCode);
+	code->instrs = c.instrs;
+	code->num_instrs = c.num_instrs;
+	code->consts = c.consts;
+	code->num_consts = c.num_consts;
+	code->sites = c.sites;
+	code->num_sites = c.num_sites;
+	code->max_stack = c.max_stack;
+
+	return code;
+}
+
+KhCode* kh_compile(KhValue *form) {
+	return _compile(form);
+}
+
+// # VM
+
+// The dispatch loop. When `in_tail` is set (the code is being run as a function body), a call in
+// tail position may be recorded for the trampoline in `kh_apply_values` instead of performed; any
+// instructions after it are guaranteed to be skippable no-argument unwrap layers, so their count
+// is passed along for the trampoline to settle.
+static KhValue* _code_run(KhContext *ctx, KhCode *code, bool in_tail) {
+	KhValue *stack[code->max_stack];
+	long sp = 0;
+
+	for (long pc = 0; pc < code->num_instrs; pc++) {
+		// Taken by pointer, as lookups resolve their lexical address in place.
+		KhInstr *instr = &code->instrs[pc];
+
+		switch (instr->op) {
+			case KH_OP_CONST:
+				stack[sp++] = code->consts[instr->arg];
+				break;
+
+			case KH_OP_LOOKUP: {
+				const char *name = KH_SYMBOL(code->consts[instr->arg])->value;
+				KhValue *value = kh_scope_lookup_addressed(kh_context_get_scope(ctx), name, &instr->addr);
+
+				// A miss may just mean the name belongs to an imported module that hasn't run yet.
+				if (value == NULL) {
+					int resolved = kh_context_resolve_pending(ctx, name);
+
+					// The module failed while loading; its error is already pending.
+					if (resolved < 0) return NULL;
+					if (resolved) value = kh_scope_lookup_addressed(kh_context_get_scope(ctx), name, &instr->addr);
+				}
+
+				if (value == NULL) KH_FAIL(undefined-variable, "%s", name);
+
+				stack[sp++] = value;
+				break;
+			}
+
+			case KH_OP_CALL: {
+				KhCallSite *site = &code->sites[instr->arg];
+				KhValue *head = stack[--sp];
+
+				// As in the old evaluator, a non-function head is returned unmodified if it had no
+				// arguments, and is an error otherwise.
+				if (!KH_IS_FUNC(head)) {
+					if (site->argc == 0) {
+						stack[sp++] = head;
+						break;
+					} else {
+						KH_FAIL(not-func, "Tried to evaluate %s as a function", kh_inspect(head));
+					}
+				}
+
+				KhFunc *func = KH_FUNC(head);
+				KhValue *result;
+
+				if (kh_func_is_direct(func)) {
+					// Direct functions get the raw, unevaluated argument forms.
+					result = kh_apply(ctx, func, site->argc, site->raw_argv);
+				} else {
+					// Everything else gets each argument's compiled fragment run first.
+					KhValue *argv[site->argc];
+
+					for (long i = 0; i < site->argc; i++) {
+						argv[i] = _code_run(ctx, site->arg_code[i], false);
+						_REQUIRE(argv[i]);
+					}
+
+					if (in_tail && site->is_tail && _kh_context_try_tail_call(ctx, func, site->argc, argv, code->num_instrs - 1 - pc)) {
+						// The trampoline takes over; the return value is ignored.
+						return kh_nil;
+					}
+
+					result = kh_apply_values(ctx, func, site->argc, argv);
+				}
+
+				_REQUIRE(result);
+				stack[sp++] = result;
+				break;
+			}
+		}
+	}
+
+	return stack[sp - 1];
+}
+
+KhValue* kh_code_run(KhContext *ctx, KhCode *code) {
+	return _code_run(ctx, code, false);
+}
+
+KhValue* kh_code_run_tail(KhContext *ctx, KhCode *code) {
+	return _code_run(ctx, code, true);
+}
+
+// # Constant folding
+//
+// An optional post-parse pass (see `KH_PARSE_FOLD_CONSTANTS`) that rewrites constant
+// subexpressions in place, so steady-state evaluation never touches them:
+//
+// * A quote around a self-evaluating atom (int, string, nil) is dropped entirely.
+// * A `+` call whose arguments all folded down to integer literals becomes its result.
+//
+// The pass assumes the core builtins have their usual meanings, and refuses to descend into
+// arguments that the direct builtins treat as data (quoted forms, the name/argument positions of
+// the `def` family, and so on). What it can't assume is the behavior of user-defined direct
+// functions; code that passes `+`-forms as unevaluated *data* to one should not enable the pass.
+
+// Interned spellings of the builtins the folder has to recognize, set up on first use.
+static const char *_sym_add, *_sym_quote, *_sym_set, *_sym_call_method, *_sym_def, *_sym_def_direct,
+	*_sym_def_method, *_sym_get_key, *_sym_record_type, *_sym_lambda, *_sym_let;
+
+static void _fold_syms_init() {
+	if (_sym_add) return;
+
+	_sym_add = kh_intern("+");
+	_sym_quote = kh_intern("quote");
+	_sym_set = kh_intern("=");
+	_sym_call_method = kh_intern("@");
+	_sym_def = kh_intern("def");
+	_sym_def_direct = kh_intern("def-direct");
+	_sym_def_method = kh_intern("def-method");
+	_sym_get_key = kh_intern("get-key");
+	_sym_record_type = kh_intern("record-type");
+	_sym_lambda = kh_intern("lambda");
+	_sym_let = kh_intern("let");
+}
+
+static KhValue* _fold(KhValue *form);
+
+// Folds each element of a list of forms (a function body, or the whole program) in place.
+static KhValue* _fold_elements(KhValue *list) {
+	for (KhValue *l = list; KH_IS_CELL(l); l = KH_CELL(l)->right) {
+		KH_CELL(l)->left = _fold(KH_CELL(l)->left);
+	}
+
+	return list;
+}
+
+// Returns the `index`th cell of a list (1-based), or NULL if the list is shorter than that.
+static KhCell* _nth_cell(KhValue *list, long index) {
+	for (; KH_IS_CELL(list); list = KH_CELL(list)->right) {
+		if (--index == 0) return KH_CELL(list);
+	}
+
+	return NULL;
+}
+
+static KhValue* _fold(KhValue *form) {
+	if (KH_IS_QUOTED(form)) {
+		KhValue *inner = KH_QUOTED(form)->value;
+
+		// Quoting a self-evaluating atom is a no-op, so the quote wrapper can go. Anything else
+		// (symbols, lists) is data, and is left alone entirely.
+		if (KH_IS_INT(inner) || KH_IS_STRING(inner) || KH_IS_NIL(inner)) return inner;
+
+		return form;
+	}
+
+	if (!KH_IS_CELL(form)) return form;
+
+	KhValue *head = KH_CELL(form)->left;
+
+	if (KH_IS_SYMBOL(head)) {
+		const char *name = KH_SYMBOL(head)->value;
+
+		// These direct builtins take symbols or whole forms as data; folding inside them would
+		// change what they see.
+		if (
+			name == _sym_quote || name == _sym_set || name == _sym_call_method ||
+			name == _sym_def_method || name == _sym_get_key || name == _sym_record_type
+		) {
+			return form;
+		}
+
+		// The function definers evaluate only their body (the last argument), so that's the only
+		// part that can be folded.
+		if (name == _sym_def || name == _sym_def_direct) {
+			KhCell *body = _nth_cell(form, 4);
+			if (body) body->left = _fold_elements(body->left);
+
+			return form;
+		}
+
+		if (name == _sym_lambda || name == _sym_let) {
+			KhCell *body = _nth_cell(form, 3);
+			if (body) body->left = _fold_elements(body->left);
+
+			return form;
+		}
+	}
+
+	// An ordinary call: fold the head and every argument.
+	_fold_elements(form);
+
+	// A `+` call whose arguments are now all integer literals becomes its result. (A bare `(+)` is
+	// left for the evaluator, which will reject its argument count.)
+	head = KH_CELL(form)->left;
+	if (KH_IS_SYMBOL(head) && KH_SYMBOL(head)->value == _sym_add && KH_IS_CELL(KH_CELL(form)->right)) {
+		long sum = 0;
+
+		for (KhValue *l = KH_CELL(form)->right; ; l = KH_CELL(l)->right) {
+			if (KH_IS_NIL(l)) return kh_int_new(sum);
+			if (!KH_IS_INT(KH_CELL(l)->left)) break;
+
+			sum += KH_INT_VALUE(KH_CELL(l)->left);
+		}
+	}
+
+	return form;
+}
+
+KhValue* kh_fold_constants(KhValue *forms) {
+	_fold_syms_init();
+
+	return _fold_elements(forms);
+}
@@ -0,0 +1,22 @@
+#ifndef __COMPILE_H__
+#define __COMPILE_H__
+
+#include "eval.h"
+#include "value.h"
+
+// A compiled form; a linear sequence of instructions plus the constants and call sites they
+// reference. The actual layout is private to `compile.c`.
+typedef struct _KhCode KhCode;
+
+KhCode* kh_compile(KhValue *form);
+KhValue* kh_code_run(KhContext *ctx, KhCode *code);
+// As `kh_code_run`, but for code run as a function body: a call in tail position may be recorded
+// for the tail-call trampoline in `kh_apply_values` rather than performed.
+KhValue* kh_code_run_tail(KhContext *ctx, KhCode *code);
+
+// Rewrites constant subexpressions of a list of parsed forms in place (quotes around
+// self-evaluating atoms, integer-literal `+` calls) and returns the list. Usually reached through
+// `KH_PARSE_FOLD_CONSTANTS` rather than called directly.
+KhValue* kh_fold_constants(KhValue *forms);
+
+#endif
@@ -28,23 +28,74 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "compile.h"
 #include "eval.h"
 #include "list.h"
+#include "parser.h"
+#include "record.h"
+#include "symbol.h"
 #include "util.h"
 #include "value.h"
 
 // # Struct definitions
 // ## Scopes
 
-// A given scope is rather simple; it only contains a link to its parent (if any) and a map of the
-// variables in it.
+// A given scope contains a link to its parent (if any) and the variables in it, in one of two
+// representations:
+//
+// * Hash scopes (the builtins/global scopes, `let` scopes) keep their variables in a `GHashTable`,
+//   as any name can be added at any time.
+// * Frame scopes (created per function application) are a flat array of slots, laid out to match
+//   the function's argument names. These are far cheaper to create and look up in, which matters
+//   since one is made for every single Scarab function call.
 struct _KhScope {
 	KhScope *parent;
 	GHashTable *table;
+
+	// Only set for frame scopes; `names` is the function's (interned) argument name array, which
+	// is shared between every frame of the same function. `table` then only exists if new
+	// variables are added beyond the fixed slots.
+	const char **names;
+	KhValue **slots;
+	long num_slots;
+	// The allocated size of `slots`, which may exceed `num_slots` for a recycled frame.
+	long slot_capacity;
+
+	// Whether anything that can outlive the current call holds a reference to this scope (a
+	// closure, or a child scope that might itself escape). Frames that never escape go back to the
+	// context's pool when their call returns; see `_frame_release`.
+	bool escaped;
+
+	// Set on a context's global scope. A fork's global scope has the template's as its parent, so
+	// globalness can't be inferred from the shape of the chain; `_capture_scope` needs it marked
+	// explicitly to tell top-level definitions from local ones.
+	bool is_global;
 };
 
+// Lexical addresses resolved against frame scopes go stale if any scope gains a name it didn't
+// have before (which may shadow what an address resolved to); this counter is bumped on every such
+// addition to invalidate them. See `kh_scope_lookup_addressed`. It is process-wide (contexts on
+// other threads - `parallel-map` workers, say - add names too), so it is accessed atomically; a
+// torn or stale read here could re-validate an address a shadowing add just killed.
+static volatile gint _scope_epoch = 0;
+
+// ## Method dispatch cache
+
+// Method dispatch would otherwise cost two hash lookups (type to table, name to function) on
+// every single call; since the same methods are called on the same types over and over, a small
+// direct-mapped cache in front of the tables makes the common case two pointer compares. Method
+// names are interned, so the cache can key on pointer identity.
+#define METHOD_CACHE_SIZE 256
+
+typedef struct {
+	KhValue *type;
+	const char *name;
+	KhFunc *func;
+} KhMethodCacheEntry;
+
 // ## Contexts
 
 // Each separate Scarab execution environment has a context, which contains the scopes, global
@@ -57,10 +108,56 @@ struct _KhContext {
 
 	// All methods defined in this context need to be tracked.
 	GHashTable *method_tables;
+	// The dispatch cache in front of them; cleared whenever a method is (re)defined.
+	KhMethodCacheEntry method_cache[METHOD_CACHE_SIZE];
+	// Direct method slot arrays for the basic types, indexed by method-name intern ID; allocated
+	// per type on first method definition. Record types carry their own (see `kh_method_add`).
+	KhFunc **basic_method_slots[KH_NUM_BASIC_TYPES];
+
+	// Set on a forked context while its method tables and slot arrays still belong to the
+	// template; the first method definition copies them (see `_methods_uncow`).
+	bool methods_shared;
+	// Permanently set on forks: record-type slot arrays live on the (shared) types themselves, so
+	// a fork can neither write them nor treat them as authoritative.
+	bool is_fork;
+
+	// Forms are compiled to bytecode the first time they are evaluated; the result is cached here
+	// (keyed by the form itself) so direct functions and Scarab function bodies don't recompile on
+	// every call.
+	GHashTable *code_cache;
+
+	// Imported modules, keyed by interned path, and the names their top-level definitions will
+	// bind, keyed by interned name; both NULL until the first `import`. See `kh_context_import`.
+	GHashTable *modules;
+	GHashTable *pending_bindings;
 
 	// We also have to keep track of the most recent error, so it is available after the
-	// interpreter's stack has unwound.
+	// interpreter's stack has unwound. Errors raised through `KH_ERROR` start out pending - just
+	// the interned type name and a message in the fixed buffer - and `error` itself is only built
+	// if `kh_get_error` is called; see `kh_set_error_fmt`.
 	KhValue *error;
+	const char *error_type;
+	char error_message[256];
+
+	// A tail call recorded by the VM for the trampoline in `kh_apply_values`; see
+	// `_kh_context_try_tail_call`.
+	bool tail_pending;
+	KhFunc *tail_func;
+	long tail_argc;
+	KhValue **tail_argv;
+	long tail_argv_capacity;
+	long tail_unwraps;
+
+	// Retired, non-escaped frame scopes, linked through their `parent` pointers, ready for reuse
+	// by the next call.
+	KhScope *frame_pool;
+
+	// Per-function call counts and timings, keyed by `KhFunc*`; NULL until profiling is first
+	// enabled. `profile_child_usec` accumulates time spent in callees of the frame currently being
+	// measured, so exclusive time can be computed; see `_apply_values_profiled`.
+	bool profiling;
+	GHashTable *profile;
+	gint64 profile_child_usec;
 };
 
 // ## Functions
@@ -83,6 +180,8 @@ struct _KhFunc {
 	const char **argnames;
 
 	KhCFunc c_func;
+	// Optional typed fast path for `c_func`; see `kh_func_new_c_int`.
+	KhCIntFunc c_int_func;
 
 	bool is_direct;
 };
@@ -101,27 +200,210 @@ extern void _register_builtins(KhScope *_builtins_scope);
 KhScope* kh_scope_new(KhScope *parent) {
 	KhScope *scope = GC_NEW(KhScope);
 	scope->parent = parent;
-	// Can use g_direct_equal as variables are referenced by symbols, which are interned
-	scope->table = g_hash_table_new(g_str_hash, g_direct_equal);
+	// Variables are referenced by interned symbols, so keys are pointer-unique; hashing the
+	// pointer itself means no lookup ever touches the string's contents.
+	scope->table = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	// A child scope can escape through a closure (which would mark only itself), so its whole
+	// parent chain has to be considered escaped too.
+	if (parent) parent->escaped = true;
+
+	return scope;
+}
+
+// Creates a frame scope, reusing a retired one from the context's pool when it is big enough;
+// `names` is borrowed (it is the function's own argument name array), and the given values are
+// copied into the slots. The common non-capturing call thus allocates nothing at all.
+static KhScope* _frame_acquire(KhContext *ctx, KhScope *parent, const char **names, long num_slots, KhValue **values) {
+	KhScope *scope = ctx->frame_pool;
+
+	if (scope && scope->slot_capacity >= num_slots) {
+		ctx->frame_pool = scope->parent;
+
+		// Clear any slots beyond the ones about to be filled, so the recycled frame doesn't pin
+		// dead values from its previous life.
+		for (long i = num_slots; i < scope->slot_capacity; i++) scope->slots[i] = NULL;
+		scope->escaped = false;
+	} else {
+		scope = GC_NEW(KhScope);
+		scope->slot_capacity = MAX(num_slots, 4);
+		scope->slots = GC_MALLOC(sizeof(KhValue*) * scope->slot_capacity);
+	}
+
+	scope->parent = parent;
+	scope->names = names;
+	scope->num_slots = num_slots;
+
+	for (long i = 0; i < num_slots; i++) scope->slots[i] = values[i];
 
 	return scope;
 }
 
+// Retires a frame scope once its call has returned. Frames that escaped, or that spilled extra
+// variables into a table, are left for the collector instead.
+static void _frame_release(KhContext *ctx, KhScope *scope) {
+	if (scope->escaped || scope->table) return;
+
+	scope->parent = ctx->frame_pool;
+	ctx->frame_pool = scope;
+}
+
+// As frame slot names and symbol values are both interned, name comparisons below are done
+// pointer-first; the `strcmp` fallback only exists for embedders passing un-interned strings.
+static long _frame_find_slot(KhScope *scope, const char *name) {
+	for (long i = 0; i < scope->num_slots; i++) {
+		if (scope->names[i] == name || strcmp(scope->names[i], name) == 0) return i;
+	}
+
+	return -1;
+}
+
 void kh_scope_add(KhScope *scope, const char *name, KhValue *val) {
+	name = kh_intern(name);
+
+	if (scope->names) {
+		long slot = _frame_find_slot(scope, name);
+
+		if (slot != -1) {
+			scope->slots[slot] = val;
+			return;
+		}
+
+		// New names in a frame scope (say, `=` introducing a variable in a function body) spill
+		// into an on-demand hash table.
+		if (!scope->table) scope->table = g_hash_table_new(g_direct_hash, g_direct_equal);
+	}
+
+	// A name this scope didn't previously contain may shadow an existing lexical address.
+	if (!g_hash_table_lookup(scope->table, name)) g_atomic_int_inc(&_scope_epoch);
+
 	// This cast is okay, as the interned string is guaranteed to continue to exist.
-	g_hash_table_replace(scope->table, (gchar*) g_intern_string(name), val);
+	g_hash_table_replace(scope->table, (gchar*) name, val);
+}
+
+// The common part of both lookup entry points: search a single scope, without following parents.
+static KhValue* _scope_get(KhScope *scope, const char *name) {
+	if (scope->names) {
+		long slot = _frame_find_slot(scope, name);
+		if (slot != -1) return scope->slots[slot];
+
+		return scope->table ? g_hash_table_lookup(scope->table, name) : NULL;
+	}
+
+	return g_hash_table_lookup(scope->table, name);
 }
 
 KhValue* kh_scope_lookup(KhScope *scope, const char *name) {
 	for (; scope != NULL; scope = scope->parent) {
-		KhValue *value = g_hash_table_lookup(scope->table, name);
+		KhValue *value = _scope_get(scope, name);
 		if (value) return value;
 	}
 
 	return NULL;
 }
 
+// This is the lookup path the VM uses. The first resolution of a name that lands in a frame scope
+// records its (depth, slot) coordinates in `addr`; later lookups then walk `depth` parent links
+// and index the frame directly, with no hashing or string comparison. The address is validated by
+// the frame's name-array identity (shared by every frame of the same function) and by the shadow
+// epoch above; any mismatch just falls back to a full walk and re-resolves.
+KhValue* kh_scope_lookup_addressed(KhScope *scope, const char *name, KhScopeAddr *addr) {
+	if (addr->names != NULL && addr->epoch == g_atomic_int_get(&_scope_epoch)) {
+		KhScope *s = scope;
+		for (long d = addr->depth; d > 0 && s != NULL; d--) s = s->parent;
+
+		if (s != NULL && s->names == addr->names) return s->slots[addr->slot];
+	}
+
+	// Sampled before the walk, so an add racing with resolution invalidates the address rather
+	// than stamping it with the newer epoch.
+	gint epoch = g_atomic_int_get(&_scope_epoch);
+
+	long depth = 0;
+	for (KhScope *s = scope; s != NULL; s = s->parent, depth++) {
+		if (s->names) {
+			long slot = _frame_find_slot(s, name);
+
+			if (slot != -1) {
+				addr->depth = depth;
+				addr->slot = slot;
+				addr->names = s->names;
+				addr->epoch = epoch;
+
+				return s->slots[slot];
+			}
+
+			if (s->table) {
+				KhValue *value = g_hash_table_lookup(s->table, name);
+				if (value) return value;
+			}
+		} else {
+			KhValue *value = g_hash_table_lookup(s->table, name);
+			if (value) return value;
+		}
+	}
+
+	return NULL;
+}
+
+// # Garbage collector control
+//
+// The Boehm collector is process-wide, so all of this - configuration, collection counts, pause
+// times - is too; contexts all share one heap. Pause tracking hooks the collector's event
+// callback and measures the stop-the-world window.
+
+static gint64 _gc_pause_start;
+static gint64 _gc_total_pause_usec;
+static gint64 _gc_max_pause_usec;
+
+static void _gc_event(GC_EventType event) {
+	switch (event) {
+		case GC_EVENT_PRE_STOP_WORLD:
+			_gc_pause_start = g_get_monotonic_time();
+			break;
+		case GC_EVENT_POST_START_WORLD: {
+			gint64 pause = g_get_monotonic_time() - _gc_pause_start;
+			_gc_total_pause_usec += pause;
+			if (pause > _gc_max_pause_usec) _gc_max_pause_usec = pause;
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+void kh_gc_configure(const KhGcConfig *config) {
+	// Incremental mode bounds individual pauses by doing a little marking at a time (at some cost
+	// in throughput); latency-sensitive embedders will want it.
+	if (config->incremental) GC_enable_incremental();
+	// Growing the heap up front avoids a flurry of early full collections while it ramps up.
+	if (config->initial_heap_size) GC_expand_hp(config->initial_heap_size);
+	if (config->max_heap_size) GC_set_max_heap_size(config->max_heap_size);
+}
+
+void kh_gc_get_stats(KhGcStats *stats) {
+	stats->collections = GC_get_gc_no();
+	stats->heap_size = GC_get_heap_size();
+	stats->free_bytes = GC_get_free_bytes();
+	stats->total_pause_usec = _gc_total_pause_usec;
+	stats->max_pause_usec = _gc_max_pause_usec;
+}
+
 // # Contexts
+//
+// ## Thread safety
+//
+// A context is single-threaded: evaluation mutates its current scope, error slot, and caches with
+// no locking, so a `KhContext` must never be used from two threads at once. What *is* safe to
+// share between threads:
+//
+// * The builtins scope (read-only once the one-time setup below has run).
+// * Interned symbol names (`kh_intern` locks internally).
+// * Any value, as long as no thread mutates it.
+//
+// So the supported pattern is one context per thread, as `parallel-map` uses. Threads that the
+// collector did not create must register themselves before allocating; see
+// `_parallel_map_worker`.
 
 // This function has to be called with the full context so that the default types can have their
 // bindings set.
@@ -129,29 +411,67 @@ KhValue* kh_scope_lookup(KhScope *scope, const char *name) {
 // Also, as the base types can be extended, it has to be called for every new context.
 extern void _register_methods(KhContext *ctx);
 
-KhContext* kh_context_new() {
-	static bool core_init_done = false;
-	
-	// This is the singleton logic for the builtins scope (and a few other small details).
-	if (!core_init_done) {
-		// For instance, we only need one nil (and this way, we can compare it pointerwise).
-		kh_nil = kh_nil_new();
+// This is the singleton logic for the builtins scope (and a few other small details).
+static gpointer _core_init(gpointer unused) {
+	// For instance, we only need one nil (and this way, we can compare it pointerwise).
+	kh_nil = kh_nil_new();
 
-		_builtins_scope = kh_scope_new(NULL);
-		_register_builtins(_builtins_scope);
+	_builtins_scope = kh_scope_new(NULL);
+	_register_builtins(_builtins_scope);
 
-		core_init_done = true;
-	}
+	// Threads created behind the collector's back (e.g. by `parallel-map`) may only call
+	// GC_register_my_thread after this.
+	GC_allow_register_threads();
+
+	// Pause tracking is always on; the callback costs two clock reads per collection.
+	GC_set_on_collection_event(_gc_event);
+
+	return NULL;
+}
+
+KhContext* kh_context_new() {
+	// `g_once` rather than a bare flag, so that contexts can be created from several threads.
+	static GOnce core_init_once = G_ONCE_INIT;
+	g_once(&core_init_once, _core_init, NULL);
 
 	KhContext *ctx = GC_NEW(KhContext);
 	ctx->global_scope = ctx->scope = kh_scope_new(_builtins_scope); // The global scope for the new context
+	ctx->global_scope->is_global = true;
 	ctx->method_tables = g_hash_table_new(g_direct_hash, g_direct_equal);
+	ctx->code_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
 
 	_register_methods(ctx);
 
 	return ctx;
 }
 
+// A cheap clone for one-context-per-tenant setups: nothing is rebuilt or copied up front. The
+// fork's global scope is a fresh, empty child of the template's, so reads fall through to the
+// shared definitions while writes land in the fork and shadow them - the template is never
+// touched. Method tables are shared until the fork first defines a method of its own
+// (`_methods_uncow`).
+//
+// The template is just that: it should be fully set up before forking and left alone afterwards,
+// and (as with any two contexts) the fork must not run concurrently with it on the same values.
+// Module registries are not shared; each fork imports for itself.
+KhContext* kh_context_fork(KhContext *base) {
+	KhContext *ctx = GC_NEW(KhContext);
+
+	ctx->global_scope = ctx->scope = kh_scope_new(base->global_scope);
+	ctx->global_scope->is_global = true;
+
+	ctx->method_tables = base->method_tables;
+	for (long i = 0; i < KH_NUM_BASIC_TYPES; i++) ctx->basic_method_slots[i] = base->basic_method_slots[i];
+	ctx->methods_shared = true;
+	ctx->is_fork = true;
+
+	// Compiled code is keyed by form and forms are shared freely, but the cache is written on
+	// every first evaluation, so each fork keeps its own.
+	ctx->code_cache = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	return ctx;
+}
+
 KhScope* kh_context_get_scope(KhContext *ctx) {
 	return ctx->scope;
 }
@@ -179,16 +499,227 @@ KhScope* kh_context_pop_scope(KhContext *ctx) {
 	return scope;
 }
 
+// # Modules
+//
+// `import` lets a program split across files without paying for library code it never touches.
+// Importing a file parses it (through the compiled-image cache, so an unchanged module costs a
+// `.khc` read rather than a parse) and records which names its top-level definitions will bind -
+// but evaluates nothing. A module's forms run, once, the first time one of those names is
+// actually referenced; see `kh_context_resolve_pending`, called from the VM's lookup miss path.
+
+typedef struct {
+	KhValue *forms;
+	bool loaded;
+	// Set while the module's forms are running, so import cycles can't recurse forever.
+	bool loading;
+} KhModule;
+
+// Returns the name a top-level form will bind, or NULL. All of the top-level definers (`def`,
+// `def-direct`, `=` and `record-type`) put the name second.
+static const char* _form_binds_name(KhValue *form) {
+	if (!KH_IS_CELL(form)) return NULL;
+
+	KhCell *cell = KH_CELL(form);
+	if (!KH_IS_SYMBOL(cell->left) || !KH_IS_CELL(cell->right)) return NULL;
+
+	const char *head = KH_SYMBOL(cell->left)->value;
+	if (head != kh_intern("def") && head != kh_intern("def-direct") && head != kh_intern("=") && head != kh_intern("record-type")) return NULL;
+
+	KhValue *name = KH_CELL(cell->right)->left;
+	return KH_IS_SYMBOL(name) ? KH_SYMBOL(name)->value : NULL;
+}
+
+KhValue* kh_context_import(KhContext *ctx, const char *path) {
+	path = kh_intern(path);
+
+	if (!ctx->modules) {
+		ctx->modules = g_hash_table_new(g_direct_hash, g_direct_equal);
+		ctx->pending_bindings = g_hash_table_new(g_direct_hash, g_direct_equal);
+	}
+
+	// Importing the same path again is a no-op, whether or not the module has run yet.
+	if (g_hash_table_lookup(ctx->modules, path)) return kh_nil;
+
+	GError *err = NULL;
+	KhValue *forms = kh_parse_file_full(path, KH_PARSE_ARENA_CELLS | KH_PARSE_FOLD_CONSTANTS, &err);
+	if (!forms) KH_FAIL(import-error, "%s", err->message);
+
+	KhModule *module = GC_NEW(KhModule);
+	module->forms = forms;
+
+	g_hash_table_insert(ctx->modules, (gchar*) path, module);
+
+	// Register the names this module will bind. On a clash, the most recent import wins, matching
+	// what eager evaluation would have done.
+	KH_ITERATE(forms) {
+		const char *name = _form_binds_name(elem);
+		if (name) g_hash_table_insert(ctx->pending_bindings, (gchar*) name, module);
+	}
+
+	return kh_nil;
+}
+
+static bool _module_load(KhContext *ctx, KhModule *module) {
+	module->loading = true;
+
+	// Module top-levels always run in the global scope, no matter where the triggering reference
+	// happened.
+	KhScope *prev_scope = ctx->scope;
+	ctx->scope = ctx->global_scope;
+
+	bool ok = true;
+	KH_ITERATE(module->forms) {
+		if (!kh_eval(ctx, elem)) {
+			ok = false;
+			break;
+		}
+	}
+
+	ctx->scope = prev_scope;
+	module->loading = false;
+	// Even a failed module counts as loaded; re-running half of it on the next reference would
+	// only compound the damage.
+	module->loaded = true;
+
+	return ok;
+}
+
+int kh_context_resolve_pending(KhContext *ctx, const char *name) {
+	if (!ctx->pending_bindings) return 0;
+
+	KhModule *module = g_hash_table_lookup(ctx->pending_bindings, name);
+	if (!module || module->loaded || module->loading) return 0;
+
+	return _module_load(ctx, module) ? 1 : -1;
+}
+
 void kh_set_error(KhContext *ctx, KhValue *error) {
 	ctx->error = error;
+	ctx->error_type = NULL;
+}
+
+void kh_set_error_fmt(KhContext *ctx, const char *type, const char *format, ...) {
+	// `type` is always a string literal (via the KH_ERROR macro), so interning it is a hash lookup
+	// with no allocation after the first raise of each type.
+	ctx->error_type = kh_intern(type);
+	ctx->error = NULL;
+
+	va_list args;
+	va_start(args, format);
+	// Overlong messages are truncated; no error message worth reading is longer than this.
+	vsnprintf(ctx->error_message, sizeof(ctx->error_message), format, args);
+	va_end(args);
 }
 
 KhValue* kh_get_error(KhContext *ctx) {
+	// Only now does a pending error get its list representation built.
+	if (ctx->error_type) {
+		ctx->error = kh_cell_new(
+			kh_symbol_new(ctx->error_type),
+			kh_cell_new(kh_string_new(ctx->error_message), kh_nil)
+		);
+		ctx->error_type = NULL;
+	}
+
 	return ctx->error;
 }
 
 // # Functions
 
+// ## Flat closure capture
+//
+// A closure that just stored its defining scope would keep the whole chain of frames and hash
+// tables alive (and un-poolable) for as long as it exists, and every free-variable reference
+// would walk that chain. When it is provably safe, definition instead skips the local chain
+// entirely and parents the closure straight on the global scope, so the defunct frames between
+// the closure and the globals can be collected or repooled.
+//
+// "Provably safe" means every symbol in the body is an argument or resolves only in the
+// global/builtins part of the chain. Any name that resolves in a local scope must be left on the
+// live chain: local bindings are mutable through `=`, so snapshotting their values at definition
+// would freeze the closure out of later reassignments (and out of sharing state with sibling
+// closures over the same local). Likewise a name that resolves nowhere may be bound into an
+// enclosing frame after definition (local recursion through `=`), so such functions also keep the
+// live chain, as before.
+
+// A small unique-symbol accumulator for the body walk.
+typedef struct {
+	const char **names;
+	long count;
+	long capacity;
+} _NameSet;
+
+static void _name_set_add(_NameSet *set, const char *name) {
+	for (long i = 0; i < set->count; i++) {
+		if (set->names[i] == name) return;
+	}
+
+	if (set->count == set->capacity) {
+		set->capacity *= 2;
+		set->names = GC_REALLOC(set->names, sizeof(char*) * set->capacity);
+	}
+
+	set->names[set->count++] = name;
+}
+
+// Collects every symbol mentioned anywhere in the form. This over-approximates the free
+// variables (symbols in data positions count too), which at worst captures a few extra slots.
+static void _collect_symbols(KhValue *form, _NameSet *set) {
+	if (KH_IS_SYMBOL(form)) {
+		_name_set_add(set, KH_SYMBOL(form)->value);
+	} else if (KH_IS_CELL(form)) {
+		_collect_symbols(KH_CELL(form)->left, set);
+		_collect_symbols(KH_CELL(form)->right, set);
+	} else if (KH_IS_QUOTED(form)) {
+		_collect_symbols(KH_QUOTED(form)->value, set);
+	}
+}
+
+// The local part of a chain is everything before the first global scope. Global scopes carry an
+// explicit mark (a fork's global scope sits on top of its template's, so chain shape alone can't
+// identify them); the only other parentless scope is the builtins scope.
+static bool _scope_is_local(KhScope *scope) {
+	return scope->parent != NULL && !scope->is_global;
+}
+
+static KhScope* _capture_scope(KhScope *scope, KhValue *form, const char **argnames, long num_args) {
+	// Top-level definitions have no local chain and nothing to flatten.
+	if (!scope || !_scope_is_local(scope)) return scope;
+
+	_NameSet set = { GC_MALLOC(sizeof(char*) * 8), 0, 8 };
+	_collect_symbols(form, &set);
+
+	KhScope *global = scope;
+	while (_scope_is_local(global)) global = global->parent;
+
+	for (long i = 0; i < set.count; i++) {
+		const char *name = set.names[i];
+
+		long j;
+		for (j = 0; j < num_args && argnames[j] != name; j++);
+		if (j < num_args) continue;
+
+		// Resolves in a local scope; that binding may be reassigned, so the closure has to see it
+		// through the live chain (see above).
+		for (KhScope *s = scope; _scope_is_local(s); s = s->parent) {
+			if (_scope_get(s, name)) {
+				scope->escaped = true;
+				return scope;
+			}
+		}
+
+		// Resolves nowhere; a local binding may yet appear, so again the live chain.
+		if (!kh_scope_lookup(global, name)) {
+			scope->escaped = true;
+			return scope;
+		}
+	}
+
+	// Everything the body mentions is an argument or global; the local chain is dead weight, and
+	// dropping it here leaves the intervening frames poolable.
+	return global;
+}
+
 KhValue* kh_func_new(const gchar *name, KhValue *form, long min_argc, long max_argc, const char **argnames, KhScope *scope, bool is_direct) {
 	KhFunc *result = _KH_NEW_BASIC(KH_FUNC_TYPE, KhFunc);
 
@@ -197,7 +728,7 @@ KhValue* kh_func_new(const gchar *name, KhValue *form, long min_argc, long max_a
 	result->min_argc = min_argc;
 	result->max_argc = max_argc;
 	result->argnames = argnames;
-	result->scope = scope;
+	result->scope = _capture_scope(scope, form, argnames, min_argc);
 	result->is_direct = is_direct;
 
 	return (KhValue*) result;
@@ -215,43 +746,161 @@ KhValue* kh_func_new_c(const gchar *name, KhCFunc c_func, long min_argc, long ma
 	return (KhValue*) result;
 }
 
+// Typed functions are never direct; the fast path only makes sense on already-evaluated values.
+KhValue* kh_func_new_c_int(const gchar *name, KhCFunc c_func, KhCIntFunc c_int_func, long min_argc, long max_argc) {
+	KhFunc *result = KH_FUNC(kh_func_new_c(name, c_func, min_argc, max_argc, false));
+	result->c_int_func = c_int_func;
+
+	return (KhValue*) result;
+}
+
 const gchar* kh_func_get_name(const KhFunc *func) {
 	return func->name;
 }
 
+bool kh_func_is_direct(const KhFunc *func) {
+	return func->is_direct;
+}
+
 // # Methods
 
+// ## Method slots
+//
+// A name whose intern ID is below this cap gets a direct slot in a per-type array, making its
+// dispatch a bounds check and two array loads with no hashing at all. Method names are interned
+// very early (during context setup and the first parse of the code that mentions them), so in
+// practice every hot method name qualifies; anything past the cap just takes the hash path below.
+#define METHOD_SLOT_CAP 64
+
+// The slot array for a type, created on demand; basic types keep theirs on the context, record
+// types on themselves.
+static KhFunc** _method_slots(KhContext *ctx, KhValue *type, bool create) {
+	if ((gsize) type < KH_NUM_BASIC_TYPES) {
+		KhFunc ***slots = &ctx->basic_method_slots[(gsize) type];
+		if (!*slots && create) *slots = GC_MALLOC(sizeof(KhFunc*) * METHOD_SLOT_CAP);
+
+		return *slots;
+	}
+
+	return kh_record_type_method_slots((KhRecordType*) type, create ? METHOD_SLOT_CAP : 0);
+}
+
+static KhMethodCacheEntry* _method_cache_entry(KhContext *ctx, KhValue *type, const char *name) {
+	return &ctx->method_cache[((((gsize) type) >> 4) ^ (((gsize) name) >> 4)) & (METHOD_CACHE_SIZE - 1)];
+}
+
+// Takes ownership of a fork's method tables and basic-type slot arrays by copying them, so the
+// definition about to happen can't reach the template or its other forks. Only the two levels of
+// tables are copied; the `KhFunc`s themselves stay shared.
+static void _methods_uncow(KhContext *ctx) {
+	GHashTable *tables = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	GHashTableIter iter;
+	gpointer type, methods;
+	g_hash_table_iter_init(&iter, ctx->method_tables);
+	while (g_hash_table_iter_next(&iter, &type, &methods)) {
+		GHashTable *copy = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+		GHashTableIter inner;
+		gpointer name, func;
+		g_hash_table_iter_init(&inner, methods);
+		while (g_hash_table_iter_next(&inner, &name, &func)) g_hash_table_insert(copy, name, func);
+
+		g_hash_table_insert(tables, type, copy);
+	}
+
+	ctx->method_tables = tables;
+
+	for (long i = 0; i < KH_NUM_BASIC_TYPES; i++) {
+		if (!ctx->basic_method_slots[i]) continue;
+
+		KhFunc **copy = GC_MALLOC(sizeof(KhFunc*) * METHOD_SLOT_CAP);
+		memcpy(copy, ctx->basic_method_slots[i], sizeof(KhFunc*) * METHOD_SLOT_CAP);
+		ctx->basic_method_slots[i] = copy;
+	}
+
+	ctx->methods_shared = false;
+}
+
 void kh_method_add(KhContext *ctx, KhValue *type, const char *name, KhFunc *func) {
 	assert(KH_IS_TYPE(type));
+
+	if (ctx->methods_shared) _methods_uncow(ctx);
+
 	GHashTable *type_methods = g_hash_table_lookup(ctx->method_tables, type);
 
 	if (type_methods == NULL) {
-		type_methods = g_hash_table_new(g_str_hash, g_str_equal);
+		// Keys are interned, so hashing and equality are by pointer.
+		type_methods = g_hash_table_new(g_direct_hash, g_direct_equal);
 		g_hash_table_insert(ctx->method_tables, type, type_methods);
 	}
 
-	g_hash_table_insert(type_methods, g_strdup(name), func);
+	const char *interned = kh_intern(name);
+	g_hash_table_insert(type_methods, (gchar*) interned, func);
+
+	// Low-ID names also land in the type's direct slot array, which then becomes authoritative
+	// for them in `kh_method_lookup`. Forks keep record-type methods out of the slots, as those
+	// arrays are on the types and shared with the template.
+	long id = kh_intern_id(interned);
+	if (id < METHOD_SLOT_CAP && (!ctx->is_fork || (gsize) type < KH_NUM_BASIC_TYPES))
+		_method_slots(ctx, type, true)[id] = func;
+
+	// Any cached dispatch may now be stale (consider a redefined method).
+	memset(ctx->method_cache, 0, sizeof(ctx->method_cache));
 }
 
 KhFunc* kh_method_lookup(KhContext *ctx, KhValue *type, const char *name) {
 	assert(KH_IS_TYPE(type));
+
+	// The cache keys on pointer identity; method names coming out of symbols are already interned,
+	// so this first probe is the whole cost of a repeated dispatch.
+	KhMethodCacheEntry *entry = _method_cache_entry(ctx, type, name);
+	if (entry->type == type && entry->name == name) return entry->func;
+
+	const char *interned = kh_intern(name);
+
+	// Slot-covered names never reach the hash tables: the slot holds the method or NULL. (Except
+	// record types in a fork, whose shared slots may not reflect the fork's own definitions.)
+	long id = kh_intern_id(interned);
+	if (id < METHOD_SLOT_CAP && (!ctx->is_fork || (gsize) type < KH_NUM_BASIC_TYPES)) {
+		KhFunc **slots = _method_slots(ctx, type, false);
+
+		return slots ? slots[id] : NULL;
+	}
+
+	if (interned != name) {
+		entry = _method_cache_entry(ctx, type, interned);
+		if (entry->type == type && entry->name == interned) return entry->func;
+	}
+
 	GHashTable *type_methods = g_hash_table_lookup(ctx->method_tables, type);
 
 	if (type_methods == NULL) return NULL;
 
-	return g_hash_table_lookup(type_methods, name);
+	KhFunc *func = g_hash_table_lookup(type_methods, interned);
+
+	if (func) {
+		entry->type = type;
+		entry->name = interned;
+		entry->func = func;
+	}
+
+	return func;
 }
 
 // # Evaluator
 
 // First, a small utility function to decide if a value is an atom:
 bool kh_is_atom(KhValue *value) {
-	switch (KH_BASIC_TYPE(value->type)) {
+	switch (KH_BASIC_TYPE(KH_VALUE_TYPE(value))) {
 		case KH_NIL_TYPE:
 		case KH_INT_TYPE:
 		case KH_STRING_TYPE:
 		case KH_FUNC_TYPE:
 		case KH_RECORD_TYPE_TYPE:
+		case KH_VECTOR_TYPE:
+		case KH_MAP_TYPE:
+		case KH_SEQ_TYPE:
 			return true;
 
 		default:
@@ -259,57 +908,62 @@ bool kh_is_atom(KhValue *value) {
 	}
 }
 
-// This evaluator is a classic Lisp-family evaluator, with (currently) no optimizations such as
-// bytecode compilation.
-KhValue* kh_eval(KhContext *ctx, KhValue *form) {
-	KhValue *value;
+// Evaluation is now a compile-then-run wrapper; forms are lowered to bytecode (once, via the
+// context's code cache) and run in the dispatch loop in `compile.c`.
+static KhCode* _form_code(KhContext *ctx, KhValue *form) {
+	KhCode *code = g_hash_table_lookup(ctx->code_cache, form);
 
+	if (code == NULL) {
+		code = kh_compile(form);
+		g_hash_table_insert(ctx->code_cache, form, code);
+	}
+
+	return code;
+}
+
+KhValue* kh_eval(KhContext *ctx, KhValue *form) {
 	// ## Atomic values
+	//
+	// These evaluate to themselves, so there is no reason to touch the cache for them.
 	if (kh_is_atom(form)) return form;
 
-	if (KH_IS_SYMBOL(form)) {
-		// Evaluating a symbol will look it up in the current and all containing scopes, returning
-		// an error if it does not exist.
-		value = kh_scope_lookup(ctx->scope, KH_SYMBOL(form)->value);
+	return kh_code_run(ctx, _form_code(ctx, form));
+}
 
-		if (value == NULL) KH_FAIL(undefined-variable, "%s", KH_SYMBOL(form)->value);
+// As above, but for a function body: calls in tail position are allowed to be recorded for the
+// trampoline below rather than performed.
+static KhValue* _eval_tail(KhContext *ctx, KhValue *form) {
+	if (kh_is_atom(form)) return form;
 
-		return value;
-	} else if (KH_IS_QUOTED(form)) {
-		// This is a value with a preceding `'`, which should be treated as if it were atomic.
-		return KH_QUOTED(form)->value;
-	}
+	return kh_code_run_tail(ctx, _form_code(ctx, form));
+}
 
-	// ## Forms
-	//
-	// First, we have to evaluate the first item in the form to figure out what we're calling.
-	KhValue *head = kh_eval(ctx, KH_CELL(form)->left);
-	_REQUIRE(head);
-
-	// If the result of that evaluation wasn't a function, we either:
-	long form_len = kh_list_length(form);
-	if (!KH_IS_FUNC(head)) {
-		if (form_len == 1) {
-			// return it unmodified if there were no arguments, or:
-			return head;
-		} else {
-			// yell if there were arguments, as this is probably an error.
-			//
-			// It may be worth doing this in all cases, as this would match Scheme and catch cases
-			// where the user thought they were calling a function that takes no arguments.
-			KH_FAIL(not-func, "Tried to evaluate %s as a function", kh_inspect(head));
-		}
+// Called by the VM when a call in tail position is about to happen. If the callee is eligible (a
+// Scarab function that is not direct, so neither its arguments nor its application can depend on
+// the scope we are about to leave), the call is recorded for the trampoline in `kh_apply_values`
+// instead of growing the C stack. Returns whether it did so.
+//
+// `unwraps` counts the skipped no-argument call layers between this call and the end of its code;
+// see `kh_apply_values` for how they are settled.
+bool _kh_context_try_tail_call(KhContext *ctx, KhFunc *func, long argc, KhValue **argv, long unwraps) {
+	if (func->c_func || func->is_direct) return false;
+
+	// The VM's argument array lives on its C stack, so it has to be copied out to survive the
+	// return. The context-owned buffer is reused across tail calls (its contents are always
+	// consumed - copied into the next frame's slots - before another tail call can be recorded),
+	// so deep tail recursion allocates nothing per iteration.
+	if (argc > ctx->tail_argv_capacity) {
+		ctx->tail_argv_capacity = MAX(argc, 8);
+		ctx->tail_argv = GC_MALLOC(sizeof(KhValue*) * ctx->tail_argv_capacity);
 	}
+	for (long i = 0; i < argc; i++) ctx->tail_argv[i] = argv[i];
 
-	// Once that error checking is done, we then make a list of all the arguments and pass it to
-	// `apply`.
-	long argc = form_len - 1;
-	KhValue *argv[argc];
+	ctx->tail_pending = true;
+	ctx->tail_func = func;
+	ctx->tail_argc = argc;
+	ctx->tail_unwraps = unwraps;
 
-	int i = 0;
-	KH_ITERATE(KH_CELL(form)->right) argv[i++] = elem;
-
-	return kh_apply(ctx, KH_FUNC(head), argc, argv);
+	return true;
 }
 
 // ## Function application
@@ -322,42 +976,182 @@ KhValue* kh_apply(KhContext *ctx, KhFunc *func, long argc, KhValue **argv) {
 		}
 	}
 
-	// Currently, argument validation is limited to checking argument counts.
-	if (argc < func->min_argc || argc > func->max_argc) {
-		// It's worth noting that `LONG_MAX` is being used as a cheap way of saying "can accept an
-		// infinite number of arguments."
-		if (func->max_argc == LONG_MAX) {
-			KH_FAIL(invalid-call, "Called %s with %ld arguments, expected %ld or more", func->name, argc, func->min_argc);
-		} else if (func->min_argc == func->max_argc) {
-			KH_FAIL(invalid-call, "Called %s with %ld arguments, expected %ld", func->name, argc, func->min_argc);
-		} else {
-			KH_FAIL(invalid-call, "Called %s with %ld arguments, expected between %ld and %ld", func->name, argc, func->min_argc, func->max_argc);
+	return kh_apply_values(ctx, func, argc, argv);
+}
+
+// This is the half of application that happens after argument evaluation; the VM calls it
+// directly when it has already run the compiled fragments for a call's arguments.
+//
+// It is also where tail calls land: a call in tail position of a function's body is recorded by
+// the VM rather than performed, and the loop below just rebinds and goes around again. Tail
+// recursion thus runs in constant C-stack space, no matter how many iterations it makes.
+static KhValue* _apply_values(KhContext *ctx, KhFunc *func, long argc, KhValue **argv) {
+	long pending_unwraps = 0;
+	KhValue *result;
+
+	while (true) {
+		// Currently, argument validation is limited to checking argument counts.
+		if (argc < func->min_argc || argc > func->max_argc) {
+			// It's worth noting that `LONG_MAX` is being used as a cheap way of saying "can accept an
+			// infinite number of arguments."
+			if (func->max_argc == LONG_MAX) {
+				KH_FAIL(invalid-call, "Called %s with %ld arguments, expected %ld or more", func->name, argc, func->min_argc);
+			} else if (func->min_argc == func->max_argc) {
+				KH_FAIL(invalid-call, "Called %s with %ld arguments, expected %ld", func->name, argc, func->min_argc);
+			} else {
+				KH_FAIL(invalid-call, "Called %s with %ld arguments, expected between %ld and %ld", func->name, argc, func->min_argc, func->max_argc);
+			}
+		}
+
+		if (func->c_func) {
+			// If the function has a typed implementation and every argument is an int, fold over
+			// raw longs; nothing is unboxed through a dispatch or boxed per step, and the single
+			// result is usually an immediate that allocates nothing either.
+			if (func->c_int_func && argc >= 1) {
+				long i;
+				for (i = 0; i < argc && KH_IS_INT(argv[i]); i++);
+
+				if (i == argc) {
+					long acc = KH_INT_VALUE(argv[0]);
+					for (i = 1; i < argc; i++) acc = func->c_int_func(acc, KH_INT_VALUE(argv[i]));
+
+					result = kh_int_new(acc);
+					break;
+				}
+			}
+
+			// Evaluating C functions is easy; we just pass off the arguments to the native
+			// implementation.
+			result = func->c_func(ctx, argc, argv);
+			break;
 		}
-	}
 
-	if (func->c_func) {
-		// Evaluating C functions is easy; we just pass off the arguments to the native
-		// implementation.
-		return func->c_func(ctx, argc, argv);
-	} else {
 		// If it's a Scarab function, we have to create a new scope whose parent is the scope where
 		// the function was defined. Lexical scoping, ladies and gentlemen.
 		//
+		// The arguments are bound as a flat frame scope; one allocation, no hash table.
+		//
 		// We also need to save the old scope to restore it at the end.
 		KhScope *prev_scope = kh_context_get_scope(ctx);
-		KhScope *func_scope = kh_scope_new(func->scope);
+		KhScope *func_scope = _frame_acquire(ctx, func->scope, func->argnames, argc, argv);
 		kh_context_set_scope(ctx, func_scope);
 
-		// Each of the argument values needs to be bound within this new scope.
-		for (long i = 0; i < argc; i++) {
-			kh_scope_add(func_scope, func->argnames[i], argv[i]);
+		// We evaluate the function's body (with tail calls allowed) and restore the old scope,
+		// retiring the frame for reuse if nothing captured it.
+		result = _eval_tail(ctx, func->form);
+		kh_context_set_scope(ctx, prev_scope);
+		_frame_release(ctx, func_scope);
+		_REQUIRE(result);
+
+		if (ctx->tail_pending) {
+			ctx->tail_pending = false;
+			func = ctx->tail_func;
+			argc = ctx->tail_argc;
+			argv = ctx->tail_argv;
+			pending_unwraps += ctx->tail_unwraps;
+			continue;
 		}
 
-		// Finally, we evaluate the function's body and restore the old scope.
-		KhValue *result = kh_eval(ctx, func->form);
+		break;
+	}
+
+	_REQUIRE(result);
+
+	// Settle any no-argument call layers a tail call skipped over: a `(f)`-shaped form calls a
+	// returned function with no arguments, and passes any other value through unchanged.
+	while (pending_unwraps > 0 && KH_IS_FUNC(result)) {
+		pending_unwraps--;
+		result = kh_apply_values(ctx, KH_FUNC(result), 0, NULL);
 		_REQUIRE(result);
-		kh_context_set_scope(ctx, prev_scope);
+	}
+
+	return result;
+}
+
+// # Profiling
+//
+// When enabled on a context, every application is counted and timed per `KhFunc`. Inclusive time
+// is wall time between entering and leaving the application; exclusive time subtracts whatever was
+// spent in profiled callees. Two caveats inherent to the scheme: recursive calls count their inner
+// activations' time again in the outer one's inclusive total, and functions reached through the
+// tail-call trampoline are attributed to the function that started the trampoline.
+
+typedef struct {
+	const char *name;
+	long calls;
+	gint64 total_usec;
+	gint64 self_usec;
+} KhProfileEntry;
+
+static KhValue* _apply_values_profiled(KhContext *ctx, KhFunc *func, long argc, KhValue **argv) {
+	KhProfileEntry *entry = g_hash_table_lookup(ctx->profile, func);
+
+	if (!entry) {
+		entry = GC_NEW(KhProfileEntry);
+		entry->name = func->name;
+		g_hash_table_insert(ctx->profile, func, entry);
+	}
+
+	entry->calls++;
+
+	// Each profiled frame measures its callees' time into the shared counter, saving and zeroing
+	// it around the application so it only sees its own children.
+	gint64 saved_child_usec = ctx->profile_child_usec;
+	ctx->profile_child_usec = 0;
+
+	gint64 start = g_get_monotonic_time();
+	KhValue *result = _apply_values(ctx, func, argc, argv);
+	gint64 elapsed = g_get_monotonic_time() - start;
+
+	entry->total_usec += elapsed;
+	entry->self_usec += elapsed - ctx->profile_child_usec;
+
+	ctx->profile_child_usec = saved_child_usec + elapsed;
+
+	return result;
+}
+
+KhValue* kh_apply_values(KhContext *ctx, KhFunc *func, long argc, KhValue **argv) {
+	// The disabled case costs exactly this branch.
+	if (G_UNLIKELY(ctx->profiling)) return _apply_values_profiled(ctx, func, argc, argv);
+
+	return _apply_values(ctx, func, argc, argv);
+}
+
+void kh_context_set_profiling(KhContext *ctx, bool enabled) {
+	// The gathered numbers deliberately survive disabling, so profiling can be toggled around a
+	// region of interest and read afterwards.
+	if (enabled && !ctx->profile) ctx->profile = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	ctx->profiling = enabled;
+}
+
+static int _profile_entry_cmp(const void *a, const void *b) {
+	gint64 a_total = (*(KhProfileEntry**) a)->total_usec, b_total = (*(KhProfileEntry**) b)->total_usec;
+
+	return a_total < b_total ? 1 : (a_total > b_total ? -1 : 0);
+}
+
+void kh_profile_report(KhContext *ctx, FILE *out) {
+	if (!ctx->profile || g_hash_table_size(ctx->profile) == 0) return;
+
+	long num_entries = g_hash_table_size(ctx->profile);
+	KhProfileEntry *entries[num_entries];
+
+	GHashTableIter iter;
+	gpointer key, value;
+	long i = 0;
+	g_hash_table_iter_init(&iter, ctx->profile);
+	while (g_hash_table_iter_next(&iter, &key, &value)) entries[i++] = value;
+
+	qsort(entries, num_entries, sizeof(KhProfileEntry*), _profile_entry_cmp);
 
-		return result;
+	fprintf(out, "%-32s %10s %12s %12s\n", "function", "calls", "total-usec", "self-usec");
+	for (i = 0; i < num_entries; i++) {
+		fprintf(
+			out, "%-32s %10ld %12lld %12lld\n",
+			entries[i]->name, entries[i]->calls,
+			(long long) entries[i]->total_usec, (long long) entries[i]->self_usec
+		);
 	}
 }
@@ -12,32 +12,101 @@ typedef struct _KhFunc KhFunc;
 
 KhScope* kh_scope_new(KhScope *parent);
 void kh_scope_add(KhScope *scope, const char *name, KhValue *val);
+KhValue* kh_scope_lookup(KhScope *scope, const char *name);
+
+// A resolved lexical address for a variable reference; see `kh_scope_lookup_addressed`. Zero it to
+// start, then reuse it across lookups of the same reference.
+typedef struct {
+	long depth;
+	long slot;
+	const char **names;
+	long epoch;
+} KhScopeAddr;
+
+KhValue* kh_scope_lookup_addressed(KhScope *scope, const char *name, KhScopeAddr *addr);
+
+// # Garbage collector control
+//
+// The collector (and so everything here) is process-wide; contexts share one heap.
+typedef struct {
+	// Bound individual pauses by collecting incrementally, at some cost in total throughput.
+	bool incremental;
+	// Sizes are in bytes; zero leaves the collector's default in place.
+	long initial_heap_size;
+	long max_heap_size;
+} KhGcConfig;
+
+typedef struct {
+	long collections;
+	long heap_size;
+	long free_bytes;
+	// Cumulative and worst-case stop-the-world time, in microseconds.
+	long total_pause_usec;
+	long max_pause_usec;
+} KhGcStats;
+
+void kh_gc_configure(const KhGcConfig *config);
+void kh_gc_get_stats(KhGcStats *stats);
 
 KhContext* kh_context_new();
+// A copy-on-write clone: the template's global definitions and methods are shared read-only, and
+// only what the fork actually changes is ever copied. The template should be fully set up before
+// forking and treated as frozen afterwards.
+KhContext* kh_context_fork(KhContext *base);
 KhScope* kh_context_get_scope(KhContext *ctx);
+
+// # Profiling
+//
+// Optional per-function call counts and inclusive/exclusive times for Scarab-level functions
+// (which C-level profilers see only as interpreter frames). Costs one branch per application when
+// disabled. The report is a table sorted by inclusive time.
+void kh_context_set_profiling(KhContext *ctx, bool enabled);
+void kh_profile_report(KhContext *ctx, FILE *out);
 void kh_context_set_scope(KhContext *ctx, KhScope *scope);
 KhScope* kh_context_new_scope(KhContext *ctx);
 KhScope* kh_context_push_scope(KhContext *ctx);
 KhScope* kh_context_pop_scope(KhContext *ctx);
 
-#define KH_ERROR(type, msg, ...) kh_set_error(ctx, kh_cell_new(kh_symbol_new(#type), kh_cell_new(kh_string_new_take(kh_strdupf(msg, ##__VA_ARGS__)), kh_nil)))
+// Raising an error only records its type and formats its message into a fixed per-context buffer;
+// the `(type (message))` list a caller sees is not built unless `kh_get_error` is actually called.
+// Code that probes for failure and retries thus pays no allocation on the failing path.
+#define KH_ERROR(type, msg, ...) kh_set_error_fmt(ctx, #type, msg, ##__VA_ARGS__)
 #define KH_FAIL(type, msg, ...) { KH_ERROR(type, msg, __VA_ARGS__); return NULL; }
 #define KH_FAIL_UNLESS(x, type, msg, ...) if (!(x)) KH_FAIL(type, msg, __VA_ARGS__)
 
 void kh_set_error(KhContext *ctx, KhValue *error);
+void kh_set_error_fmt(KhContext *ctx, const char *type, const char *format, ...);
 KhValue* kh_get_error(KhContext *ctx);
 
 typedef KhValue* (*KhCFunc)(KhContext *ctx, long argc, KhValue **argv);
 KhValue* kh_func_new(const gchar *name, KhValue *form, long min_argc, long max_argc, const char **argnames, KhScope *scope, bool is_direct);
 KhValue* kh_func_new_c(const gchar *name, KhCFunc c_func, long min_argc, long max_argc, bool is_direct);
+
+// A typed variant for numeric builtins: combines two raw longs, and is applied as a left fold
+// over the arguments. When every argument at a call is an int, application goes straight from
+// unboxed long to unboxed long; `c_func` remains the fallback for everything else (including
+// error reporting on bad types).
+typedef long (*KhCIntFunc)(long left, long right);
+KhValue* kh_func_new_c_int(const gchar *name, KhCFunc c_func, KhCIntFunc c_int_func, long min_argc, long max_argc);
+
 const gchar* kh_func_get_name(const KhFunc *func);
+bool kh_func_is_direct(const KhFunc *func);
 
 void kh_method_add(KhContext *ctx, KhValue *type, const char *name, KhFunc *func);
 KhFunc* kh_method_lookup(KhContext *ctx, KhValue *type, const char *name);
 
+// Registers a module: the file is parsed (through the compiled-image cache) and the names its
+// top-level definitions bind are recorded, but nothing is evaluated until one of those names is
+// first referenced. Importing an already-imported path is a no-op.
+KhValue* kh_context_import(KhContext *ctx, const char *path);
+// Called on a lookup miss: runs the not-yet-run module that binds `name`, if there is one.
+// Returns 1 if the module ran cleanly (the lookup is worth retrying), -1 if it failed (its error
+// is pending on the context), and 0 if there was nothing to do.
+int kh_context_resolve_pending(KhContext *ctx, const char *name);
+
 KhValue* kh_eval(KhContext *ctx, KhValue *form);
 KhValue* kh_apply(KhContext *ctx, KhFunc *func, long argc, KhValue **argv);
-KhValue* kh_apply_values(KhContext *ctx, KhFunc *func, ...);
+KhValue* kh_apply_values(KhContext *ctx, KhFunc *func, long argc, KhValue **argv);
 
 bool kh_is_atom(KhValue *value);
 
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2015 Jesse Weaver <pianohacker@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Serialized images of parsed scripts. After a successful parse, the form tree is written in a
+// compact tagged format to `<script>.khc` beside the source; on later runs, `kh_parse_file` loads
+// that image and skips tokenizing and parsing altogether, which matters for the rapid-startup
+// goal when the same scripts are run over and over.
+//
+// An image is validated against the source file's modification time and size; anything stale,
+// truncated or otherwise unrecognizable is silently ignored (and rewritten after the next real
+// parse). The format is an internal cache, not an interchange format, so there is no attempt at
+// cross-machine portability.
+
+#include <gc.h>
+#include <glib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "strfuncs.h"
+#include "value.h"
+
+#define IMAGE_MAGIC "SCRB"
+#define IMAGE_VERSION 1
+// Magic, version byte, then the source's mtime and size as 64-bit values.
+#define IMAGE_HEADER_SIZE (4 + 1 + 8 + 8)
+
+// Node tags; every value the parser can produce is one of these.
+enum {
+	IMG_NIL,
+	IMG_INT,
+	IMG_STRING,
+	IMG_SYMBOL,
+	IMG_QUOTED,
+	IMG_CELL,
+};
+
+static char* _image_filename(const char *filename) {
+	size_t len = strlen(filename);
+
+	// `foo.kh` caches as `foo.khc`; anything else just gets `.khc` appended.
+	if (len > 3 && strcmp(filename + len - 3, ".kh") == 0) return kh_strdupf("%sc", filename);
+
+	return kh_strdupf("%s.khc", filename);
+}
+
+// # Writing
+
+static void _write_value(GString *out, KhValue *value, bool *ok) {
+	if (KH_IS_NIL(value)) {
+		g_string_append_c(out, IMG_NIL);
+	} else if (KH_IS_INT(value)) {
+		long v = KH_INT_VALUE(value);
+
+		g_string_append_c(out, IMG_INT);
+		g_string_append_len(out, (char*) &v, sizeof(v));
+	} else if (KH_IS_STRING(value) || KH_IS_SYMBOL(value)) {
+		const char *str = KH_IS_STRING(value) ? KH_STRING(value)->value : KH_SYMBOL(value)->value;
+		guint32 len = KH_IS_STRING(value) ? KH_STRING(value)->length : strlen(str);
+
+		g_string_append_c(out, KH_IS_STRING(value) ? IMG_STRING : IMG_SYMBOL);
+		g_string_append_len(out, (char*) &len, sizeof(len));
+		g_string_append_len(out, str, len);
+	} else if (KH_IS_QUOTED(value)) {
+		g_string_append_c(out, IMG_QUOTED);
+		_write_value(out, KH_QUOTED(value)->value, ok);
+	} else if (KH_IS_CELL(value)) {
+		g_string_append_c(out, IMG_CELL);
+		_write_value(out, KH_CELL(value)->left, ok);
+		_write_value(out, KH_CELL(value)->right, ok);
+	} else {
+		// Shouldn't happen for parser output; give up on the image rather than write a lie.
+		*ok = false;
+	}
+}
+
+void kh_image_try_save(const char *filename, KhValue *forms) {
+	struct stat src;
+	if (stat(filename, &src) != 0) return;
+
+	GString *out = g_string_sized_new(4096);
+	g_string_append_len(out, IMAGE_MAGIC, 4);
+	g_string_append_c(out, IMAGE_VERSION);
+
+	gint64 mtime = src.st_mtime;
+	gint64 size = src.st_size;
+	g_string_append_len(out, (char*) &mtime, sizeof(mtime));
+	g_string_append_len(out, (char*) &size, sizeof(size));
+
+	bool ok = true;
+	_write_value(out, forms, &ok);
+
+	// Failure to write is no worse than having no cache.
+	if (ok) g_file_set_contents(_image_filename(filename), out->str, out->len, NULL);
+
+	g_string_free(out, TRUE);
+}
+
+// # Reading
+
+typedef struct {
+	const char *data;
+	gsize len;
+	gsize pos;
+	bool ok;
+} ImageReader;
+
+static bool _read_bytes(ImageReader *r, void *out, gsize n) {
+	if (r->pos + n > r->len) {
+		r->ok = false;
+		return false;
+	}
+
+	memcpy(out, r->data + r->pos, n);
+	r->pos += n;
+
+	return true;
+}
+
+static KhValue* _read_value(ImageReader *r) {
+	char tag;
+	if (!_read_bytes(r, &tag, 1)) return NULL;
+
+	switch (tag) {
+		case IMG_NIL:
+			return kh_nil;
+
+		case IMG_INT: {
+			long v;
+			if (!_read_bytes(r, &v, sizeof(v))) return NULL;
+
+			return kh_int_new(v);
+		}
+
+		case IMG_STRING:
+		case IMG_SYMBOL: {
+			guint32 len;
+			if (!_read_bytes(r, &len, sizeof(len))) return NULL;
+
+			if (r->pos + len > r->len) {
+				r->ok = false;
+				return NULL;
+			}
+
+			char *str = GC_MALLOC_ATOMIC(len + 1);
+			memcpy(str, r->data + r->pos, len);
+			str[len] = '\0';
+			r->pos += len;
+
+			return tag == IMG_STRING ? kh_string_new_take(str) : kh_symbol_new(str);
+		}
+
+		case IMG_QUOTED: {
+			KhValue *value = _read_value(r);
+
+			return value ? kh_quoted_new(value) : NULL;
+		}
+
+		case IMG_CELL: {
+			KhValue *left = _read_value(r);
+			if (!left) return NULL;
+
+			KhValue *right = _read_value(r);
+			if (!right) return NULL;
+
+			return kh_cell_new(left, right);
+		}
+
+		default:
+			r->ok = false;
+			return NULL;
+	}
+}
+
+KhValue* kh_image_try_load(const char *filename) {
+	struct stat src;
+	if (stat(filename, &src) != 0) return NULL;
+
+	gchar *data;
+	gsize len;
+	if (!g_file_get_contents(_image_filename(filename), &data, &len, NULL)) return NULL;
+
+	KhValue *result = NULL;
+
+	if (len >= IMAGE_HEADER_SIZE && memcmp(data, IMAGE_MAGIC, 4) == 0 && data[4] == IMAGE_VERSION) {
+		gint64 mtime, size;
+		memcpy(&mtime, data + 5, sizeof(mtime));
+		memcpy(&size, data + 13, sizeof(size));
+
+		if (mtime == (gint64) src.st_mtime && size == (gint64) src.st_size) {
+			ImageReader r = { data, len, IMAGE_HEADER_SIZE, true };
+
+			result = _read_value(&r);
+
+			// A trailing-garbage image is treated as corrupt, too.
+			if (!r.ok || r.pos != r.len) result = NULL;
+		}
+	}
+
+	g_free(data);
+
+	return result;
+}
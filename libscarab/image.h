@@ -0,0 +1,13 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include "value.h"
+
+// The compiled-image cache: a serialized copy of a script's parsed forms, written next to the
+// source file so later runs can load it directly and skip the tokenizer and parser entirely.
+// Both functions are best-effort; a missing, stale or corrupt image just means a normal parse.
+
+KhValue* kh_image_try_load(const char *filename);
+void kh_image_try_save(const char *filename, KhValue *forms);
+
+#endif
@@ -34,7 +34,11 @@ long kh_list_length(KhValue *list) {
 }
 
 KhValue* kh_list_append(KhValue *list, KhValue *value) {
-	KhValue *new_tail = kh_cell_new(value, kh_nil);
+	return kh_list_append_in(NULL, list, value);
+}
+
+KhValue* kh_list_append_in(KhCellArena *arena, KhValue *list, KhValue *value) {
+	KhValue *new_tail = kh_cell_new_in(arena, value, kh_nil);
 	if (KH_IS_CELL(list)) {
 		KhCell *tail = KH_CELL(list);
 
@@ -53,9 +57,35 @@ KhValue* kh_list_append(KhValue *list, KhValue *value) {
 	}
 }
 
+void kh_list_builder_init(KhListBuilder *builder, KhCellArena *arena) {
+	builder->head = kh_nil;
+	builder->tail = NULL;
+	builder->arena = arena;
+}
+
+void kh_list_builder_append(KhListBuilder *builder, KhValue *value) {
+	KhValue *new_tail = kh_cell_new_in(builder->arena, value, kh_nil);
+
+	if (builder->tail) {
+		builder->tail->right = new_tail;
+	} else {
+		builder->head = new_tail;
+	}
+
+	builder->tail = KH_CELL(new_tail);
+}
+
+KhValue* kh_list_builder_finish(KhListBuilder *builder) {
+	return builder->head;
+}
+
 KhValue* kh_list_prepend(KhValue *list, KhValue *value) {
+	return kh_list_prepend_in(NULL, list, value);
+}
+
+KhValue* kh_list_prepend_in(KhCellArena *arena, KhValue *list, KhValue *value) {
 	if (KH_IS_CELL(list) || KH_IS_NIL(list)) {
-		return kh_cell_new(value, (KhValue*) list);
+		return kh_cell_new_in(arena, value, (KhValue*) list);
 	} else {
 		puts("WTF"); abort();
 	}
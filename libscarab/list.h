@@ -11,4 +11,23 @@ long kh_list_length(KhValue *list);
 KhValue* kh_list_append(KhValue *list, KhValue *value);
 KhValue* kh_list_prepend(KhValue *list, KhValue *value);
 
+// The `_in` variants allocate their new cell out of the given arena (see `kh_cell_new_in`).
+KhValue* kh_list_append_in(KhCellArena *arena, KhValue *list, KhValue *value);
+KhValue* kh_list_prepend_in(KhCellArena *arena, KhValue *list, KhValue *value);
+
+// A head/tail-pointer list builder. `kh_list_append` re-walks to the tail on every call, so
+// building an N-element list with it is O(N²); a builder remembers the tail and builds front to
+// back in O(N). Init (with an optional arena), append, then take the result with `_finish`.
+typedef struct {
+	KhValue *head;
+	KhCell *tail;
+	KhCellArena *arena;
+} KhListBuilder;
+
+void kh_list_builder_init(KhListBuilder *builder, KhCellArena *arena);
+void kh_list_builder_append(KhListBuilder *builder, KhValue *value);
+// Returns the built list (nil if nothing was appended). The builder can be reused after
+// re-initializing it.
+KhValue* kh_list_builder_finish(KhListBuilder *builder);
+
 #endif
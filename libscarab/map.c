@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015 Jesse Weaver <pianohacker@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Where a record (`record.c`) has a key set fixed by its type, a map is a free-form key-value
+// table whose keys can come and go at runtime. Before this existed, dynamic dictionaries were
+// emulated with association lists, paying an O(n) `strcmp`-laden walk per lookup; a map is the
+// same open-addressed, interned-key design as the record type's key index, so a lookup in a
+// 100k-entry table costs a hash and a probe or two.
+
+#include <gc.h>
+#include <glib.h>
+#include <stdbool.h>
+
+#include "map.h"
+#include "symbol.h"
+#include "value.h"
+
+struct _KhMap {
+	KhValue base;
+
+	long size;
+
+	// A power-of-two-sized probe table of interned key pointers and their values, kept at most
+	// half full so probe chains stay short. There is no deletion, so no tombstones either.
+	const char **keys;
+	KhValue **values;
+	long table_size;
+};
+
+static guint _key_hash(const char *key) {
+	// Interned keys are compared by identity, so the hash is just a scramble of the pointer.
+	return (guint) ((((gsize) key) >> 3) * 2654435761u);
+}
+
+KhValue* kh_map_new() {
+	KhMap *map = _KH_NEW_BASIC(KH_MAP_TYPE, KhMap);
+
+	map->table_size = 8;
+	map->keys = GC_MALLOC(sizeof(char*) * map->table_size);
+	map->values = GC_MALLOC(sizeof(KhValue*) * map->table_size);
+
+	return (KhValue*) map;
+}
+
+long kh_map_size(const KhMap *map) {
+	return map->size;
+}
+
+// Finds the slot where the (interned) key lives, or the empty slot where it would go.
+static long _probe(const KhMap *map, const char *key) {
+	long mask = map->table_size - 1;
+
+	long i = _key_hash(key) & mask;
+	while (map->keys[i] && map->keys[i] != key) i = (i + 1) & mask;
+
+	return i;
+}
+
+static void _grow(KhMap *map) {
+	const char **old_keys = map->keys;
+	KhValue **old_values = map->values;
+	long old_size = map->table_size;
+
+	map->table_size *= 2;
+	map->keys = GC_MALLOC(sizeof(char*) * map->table_size);
+	map->values = GC_MALLOC(sizeof(KhValue*) * map->table_size);
+
+	for (long i = 0; i < old_size; i++) {
+		if (!old_keys[i]) continue;
+
+		long j = _probe(map, old_keys[i]);
+		map->keys[j] = old_keys[i];
+		map->values[j] = old_values[i];
+	}
+}
+
+void kh_map_set(KhMap *map, const char *key, KhValue *value) {
+	key = kh_intern(key);
+
+	long i = _probe(map, key);
+
+	if (!map->keys[i]) {
+		map->keys[i] = key;
+		map->size++;
+
+		if (map->size * 2 > map->table_size) _grow(map);
+
+		// The slot may have moved.
+		i = _probe(map, key);
+	}
+
+	map->values[i] = value;
+}
+
+KhValue* kh_map_get(const KhMap *map, const char *key) {
+	long i = _probe(map, key);
+	if (map->keys[i]) return map->values[i];
+
+	// The caller's key may not have been the interned pointer; intern it and retry once.
+	const char *interned = kh_intern(key);
+	if (interned != key) {
+		i = _probe(map, interned);
+		if (map->keys[i]) return map->values[i];
+	}
+
+	return NULL;
+}
+
+bool kh_map_foreach(const KhMap *map, bool (*callback)(const char*, KhValue*, void*), void *userdata) {
+	for (long i = 0; i < map->table_size; i++) {
+		if (!map->keys[i]) continue;
+
+		if (!callback(map->keys[i], map->values[i], userdata)) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,20 @@
+#ifndef __MAP_H__
+#define __MAP_H__
+
+#include <stdbool.h>
+
+#include "value.h"
+
+typedef struct _KhMap KhMap;
+
+KhValue* kh_map_new();
+long kh_map_size(const KhMap *map);
+// Both take interned-or-not keys; interning (and hashing) happens inside, so a lookup is a hash of
+// the interned pointer plus a pointer compare or two.
+void kh_map_set(KhMap *map, const char *key, KhValue *value);
+// Returns NULL (not nil) for a missing key, so callers can tell "absent" from "set to nil".
+KhValue* kh_map_get(const KhMap *map, const char *key);
+// Iterates in no particular order; stops early (returning false) if the callback does.
+bool kh_map_foreach(const KhMap *map, bool (*callback)(const char*, KhValue*, void*), void *userdata);
+
+#endif
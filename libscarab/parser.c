@@ -24,19 +24,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "compile.h"
 #include "error.h"
+#include "image.h"
 #include "list.h"
 #include "parser.h"
 #include "strfuncs.h"
 #include "tokenizer.h"
 #include "util.h"
 
-typedef struct {
+// The struct tag is what `KhParser` in parser.h points at; internal code keeps the older
+// `KhParserContext` name.
+struct _KhParserContext {
 	KhTokenizer *tokenizer;
 
+	// Only consulted by the incremental entry points; the batch ones apply their flags up front.
+	KhParseFlags flags;
+
+	// NULL unless `KH_PARSE_ARENA_CELLS` was requested; see `kh_cell_arena_new`.
+	KhCellArena *arena;
+
 	bool has_peek;
 	KhToken peek_token;
-} KhParserContext;
+};
+typedef struct _KhParserContext KhParserContext;
 
 #define EXPECT(...) if (!_expect(self, token, err, __VA_ARGS__, 0)) return NULL;
 
@@ -205,7 +216,10 @@ static KhValue* _parse_identifier(KhParserContext *self, GError **err) {
 static KhValue* _parse_value(KhParserContext *self, GError **err);
 
 static KhValue* _parse_operator_list(KhParserContext *self, KhTokenType terminator, GError **err) {
-	KhValue *result = kh_nil;
+	// Lists are built through a tail-pointer builder; naive `kh_list_append` would make parsing a
+	// long list quadratic in its length.
+	KhListBuilder builder;
+	kh_list_builder_init(&builder, self->arena);
 	KhValue *operator = NULL;
 	KhToken token = KH_TOKEN_EMPTY;
 
@@ -215,7 +229,7 @@ static KhValue* _parse_operator_list(KhParserContext *self, KhTokenType terminat
 	if (!_token_type_is_value(token.type)) {
 		_REQUIRE(_ignore_newlines(self, err));
 		EXPECT(terminator);
-		return result;
+		return kh_nil;
 	}
 
 	while (true) {
@@ -237,7 +251,7 @@ static KhValue* _parse_operator_list(KhParserContext *self, KhTokenType terminat
 
 		if (!new_value) return NULL;
 
-		result = kh_list_append(result, new_value);
+		kh_list_builder_append(&builder, new_value);
 
 		_REQUIRE(_ignore_newlines(self, err));
 		_REQUIRE(_peek(self, &token, err));
@@ -261,16 +275,20 @@ static KhValue* _parse_operator_list(KhParserContext *self, KhTokenType terminat
 		} else {
 			operator = _parse_value(self, err);
 
-			result = kh_list_prepend(result, operator);
+			if (!operator) return NULL;
 		}
 
 	}
 
-	return result;
+	// The operator goes in front of the values; prepending once at the end is O(1).
+	KhValue *result = kh_list_builder_finish(&builder);
+
+	return operator ? kh_list_prepend_in(self->arena, result, operator) : result;
 }
 
 static KhValue* _parse_closed_list(KhParserContext *self, KhTokenType terminator, GError **err) {
-	KhValue *result = kh_nil;
+	KhListBuilder builder;
+	kh_list_builder_init(&builder, self->arena);
 
 	KhToken token = KH_TOKEN_EMPTY;
 	while (true) {
@@ -296,14 +314,15 @@ static KhValue* _parse_closed_list(KhParserContext *self, KhTokenType terminator
 
 		if (!new_value) return NULL;
 
-		result = kh_list_append(result, new_value);
+		kh_list_builder_append(&builder, new_value);
 	}
 
-	return result;
+	return kh_list_builder_finish(&builder);
 }
 
 static KhValue* _parse_open_list(KhParserContext *self, KhTokenType terminator, GError **err) {
-	KhValue *result = kh_nil;
+	KhListBuilder builder;
+	kh_list_builder_init(&builder, self->arena);
 
 	KhToken token = KH_TOKEN_EMPTY;
 	while (true) {
@@ -314,7 +333,7 @@ static KhValue* _parse_open_list(KhParserContext *self, KhTokenType terminator,
 
 			if (!new_value) return NULL;
 
-			result = kh_list_append(result, new_value);
+			kh_list_builder_append(&builder, new_value);
 
 			_REQUIRE(_peek(self, &token, err));
 		}
@@ -328,7 +347,7 @@ static KhValue* _parse_open_list(KhParserContext *self, KhTokenType terminator,
 		}
 	}
 
-	return result;
+	return kh_list_builder_finish(&builder);
 }
 
 static KhValue* _parse_value(KhParserContext *self, GError **err) {
@@ -408,7 +427,7 @@ static KhValue* _parse(KhParserContext *self, GError **err) {
 	return result;
 }
 
-KhValue* kh_parse_string(const char *str, GError **err) {
+KhValue* kh_parse_string_full(const char *str, KhParseFlags flags, GError **err) {
 	KhParserContext *self = GC_NEW(KhParserContext);
 	self->tokenizer = kh_tokenizer_new_from_string(str, err);
 
@@ -416,10 +435,55 @@ KhValue* kh_parse_string(const char *str, GError **err) {
 		return NULL;
 	}
 
-	return _parse(self, err);
+	if (flags & KH_PARSE_ARENA_CELLS) self->arena = kh_cell_arena_new(0);
+
+	KhValue *result = _parse(self, err);
+
+	if (result && (flags & KH_PARSE_FOLD_CONSTANTS)) result = kh_fold_constants(result);
+
+	return result;
+}
+
+KhValue* kh_parse_string(const char *str, GError **err) {
+	return kh_parse_string_full(str, KH_PARSE_DEFAULT, err);
+}
+
+KhValue* kh_parse_file_full(const char *filename, KhParseFlags flags, GError **err) {
+	// A valid compiled image beside the file means we can skip tokenizing and parsing entirely.
+	// (The image may have been written by a run with different flags, so folding is reapplied;
+	// it's cheap and idempotent.)
+	KhValue *cached = kh_image_try_load(filename);
+	if (cached) return (flags & KH_PARSE_FOLD_CONSTANTS) ? kh_fold_constants(cached) : cached;
+
+	KhParserContext *self = GC_NEW(KhParserContext);
+	self->tokenizer = kh_tokenizer_new(filename, err);
+
+	if (!self->tokenizer) {
+		return NULL;
+	}
+
+	if (flags & KH_PARSE_ARENA_CELLS) self->arena = kh_cell_arena_new(0);
+
+	KhValue *result = _parse(self, err);
+
+	if (result && (flags & KH_PARSE_FOLD_CONSTANTS)) result = kh_fold_constants(result);
+
+	// Cache the parse (post-folding) for the next run; failure to do so is harmless.
+	if (result) kh_image_try_save(filename, result);
+
+	return result;
 }
 
 KhValue* kh_parse_file(const char *filename, GError **err) {
+	return kh_parse_file_full(filename, KH_PARSE_DEFAULT, err);
+}
+
+// # Incremental parsing
+//
+// These hand back the parser state itself, so the caller can pull top-level forms one at a time
+// with `kh_parse_next_form` instead of materializing the whole program up front.
+
+KhParser* kh_parser_new(const char *filename, KhParseFlags flags, GError **err) {
 	KhParserContext *self = GC_NEW(KhParserContext);
 	self->tokenizer = kh_tokenizer_new(filename, err);
 
@@ -427,5 +491,56 @@ KhValue* kh_parse_file(const char *filename, GError **err) {
 		return NULL;
 	}
 
-	return _parse(self, err);
+	self->flags = flags;
+	if (flags & KH_PARSE_ARENA_CELLS) self->arena = kh_cell_arena_new(0);
+
+	return self;
+}
+
+KhParser* kh_parser_new_from_string(const char *str, KhParseFlags flags, GError **err) {
+	KhParserContext *self = GC_NEW(KhParserContext);
+	self->tokenizer = kh_tokenizer_new_from_string(str, err);
+
+	if (!self->tokenizer) {
+		return NULL;
+	}
+
+	self->flags = flags;
+	if (flags & KH_PARSE_ARENA_CELLS) self->arena = kh_cell_arena_new(0);
+
+	return self;
+}
+
+bool kh_parse_next_form(KhParser *self, KhValue **form, GError **err) {
+	*form = NULL;
+
+	KhToken token = KH_TOKEN_EMPTY;
+
+	// Skip any separators left over from the previous form.
+	while (true) {
+		_REQUIRE(_peek(self, &token, err));
+
+		if (token.type == ',' || token.type == '\n') {
+			_consume(self);
+		} else {
+			break;
+		}
+	}
+
+	if (token.type == T_EOF) return true;
+
+	// This mirrors one pass of the loop in `_parse_open_list`; the closed-list parser stops at
+	// (without consuming) the `,`/`\n`/EOF that follows the form, which the next call skips.
+	KhValue *result = _parse_closed_list(self, T_EOF, err);
+	_REQUIRE(result);
+
+	if (self->flags & KH_PARSE_FOLD_CONSTANTS) {
+		// The folder works on a list of forms, so give it a one-element one.
+		KhValue *wrapper = kh_cell_new(result, kh_nil);
+		result = KH_CELL(kh_fold_constants(wrapper))->left;
+	}
+
+	*form = result;
+
+	return true;
 }
@@ -20,10 +20,38 @@
 #define __PARSER_H__
 
 #include <glib.h>
+#include <stdbool.h>
 
 #include "value.h"
 
+typedef enum {
+	KH_PARSE_DEFAULT = 0,
+	// Allocate the parse's cons cells out of bump-pointer slabs (see `KhCellArena` in value.h).
+	// Faster and friendlier to the cache for whole files; pointless for small interactive input.
+	KH_PARSE_ARENA_CELLS = 1 << 0,
+	// Pre-evaluate constant subexpressions after parsing (see `kh_fold_constants` in compile.h).
+	// Assumes the core builtins keep their usual meanings.
+	KH_PARSE_FOLD_CONSTANTS = 1 << 1,
+} KhParseFlags;
+
 KhValue* kh_parse_string(const char *string, GError **err);
 KhValue* kh_parse_file(const char *filename, GError **err);
 
+KhValue* kh_parse_string_full(const char *string, KhParseFlags flags, GError **err);
+KhValue* kh_parse_file_full(const char *filename, KhParseFlags flags, GError **err);
+
+// # Incremental parsing
+//
+// An alternative to the whole-program entry points above: create a parser, then pull top-level
+// forms out of it one at a time. Forms already handed back can be evaluated (and collected) while
+// the rest of the input is still unparsed, which keeps memory flat for large streams.
+typedef struct _KhParserContext KhParser;
+
+KhParser* kh_parser_new(const char *filename, KhParseFlags flags, GError **err);
+KhParser* kh_parser_new_from_string(const char *string, KhParseFlags flags, GError **err);
+
+// Parses the next top-level form into `*form`. Returns false (with `err` set) on a syntax error;
+// at end of input, returns true with `*form` set to NULL.
+bool kh_parse_next_form(KhParser *self, KhValue **form, GError **err);
+
 #endif
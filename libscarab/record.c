@@ -20,23 +20,42 @@
 // depending on the record's type.
 
 #include <gc.h>
+#include <glib.h>
 #include <stdbool.h>
-#include <string.h>
 
 #include "record.h"
+#include "symbol.h"
 #include "value.h"
 
 // # Record types
 //
 // A record type holds all the defined keys for that type and any other bookkeeping information.
+//
+// Keys are interned, and each type carries a small open-addressed index from interned key pointer
+// to slot, so looking up a field is a hash of the pointer plus a pointer compare or two - not a
+// `strcmp` walk over every key of the type.
 
 struct _KhRecordType {
 	KhValue base;
 
 	int num_keys;
 	const char **keys;
+
+	// The key index; a power-of-two-sized probe table of interned key pointers and their slots.
+	const char **index_keys;
+	long *index_slots;
+	long index_size;
+
+	// Direct method-dispatch slots; NULL until a method is defined on this type. The layout
+	// belongs to eval.c, which hands out the indexes.
+	struct _KhFunc **method_slots;
 };
 
+static guint _key_hash(const char *key) {
+	// Interned keys are compared by identity, so the hash is just a scramble of the pointer.
+	return (guint) ((((gsize) key) >> 3) * 2654435761u);
+}
+
 // We expect the array of strings to be `NULL`-terminated.
 KhValue* kh_record_type_new(const char **keys) {
 	KhRecordType *type = _KH_NEW_BASIC(KH_RECORD_TYPE_TYPE, KhRecordType);
@@ -48,16 +67,58 @@ KhValue* kh_record_type_new(const char **keys) {
 	type->keys = GC_MALLOC(sizeof(char*) * num_keys);
 
 	for (int i = 0; i < num_keys; i++) {
-		type->keys[i] = GC_STRDUP(keys[i]);
+		type->keys[i] = kh_intern(keys[i]);
+	}
+
+	// Keep the index at most half full so probe chains stay short.
+	long size = 4;
+	while (size < num_keys * 2) size <<= 1;
+
+	type->index_size = size;
+	type->index_keys = GC_MALLOC(sizeof(char*) * size);
+	type->index_slots = GC_MALLOC(sizeof(long) * size);
+
+	for (long i = 0; i < num_keys; i++) {
+		long j = _key_hash(type->keys[i]) & (size - 1);
+		while (type->index_keys[j]) j = (j + 1) & (size - 1);
+
+		type->index_keys[j] = type->keys[i];
+		type->index_slots[j] = i;
 	}
 
 	return (KhValue*) type;
 }
 
+static long _index_lookup(const KhRecordType *type, const char *key) {
+	long mask = type->index_size - 1;
+
+	for (long i = _key_hash(key) & mask; ; i = (i + 1) & mask) {
+		if (type->index_keys[i] == key) return type->index_slots[i];
+		if (type->index_keys[i] == NULL) return -1;
+	}
+}
+
+long kh_record_type_key_index(const KhRecordType *type, const char *key) {
+	long slot = _index_lookup(type, key);
+	if (slot != -1) return slot;
+
+	// The caller's key may not have been the interned pointer; intern it and retry once.
+	const char *interned = kh_intern(key);
+	if (interned != key) return _index_lookup(type, interned);
+
+	return -1;
+}
+
 long kh_record_type_get_num_keys(const KhRecordType *type) {
 	return type->num_keys;
 }
 
+struct _KhFunc** kh_record_type_method_slots(KhRecordType *type, long size) {
+	if (!type->method_slots && size > 0) type->method_slots = GC_MALLOC(sizeof(struct _KhFunc*) * size);
+
+	return type->method_slots;
+}
+
 // # Records
 //
 // Each record has a link back to its type and a list of values in the same order as the original
@@ -73,22 +134,13 @@ KhValue* kh_record_new(const KhRecordType *type, const char **keys, KhValue* con
 	KhRecord *record = GC_MALLOC(sizeof(KhRecord) + type->num_keys * sizeof(KhValue*));
 	((KhValue*) record)->type = (KhValue*) type;
 
-	int num_keys = 0;
-	while (keys[num_keys]) num_keys++;
+	// Record values default to `nil`.
+	for (int i = 0; i < type->num_keys; i++) record->values[i] = kh_nil;
 
-	// We do this slightly backwards (and without `kh_record_set`) to make it easier to fill in
-	// `nil`-defaults.
-	for (int i = 0; i < type->num_keys; i++) {
-		int j;
-		for (j = 0; j < num_keys; j++) {
-			if (strcmp(type->keys[i], keys[j]) == 0) {
-				record->values[i] = values[j];
-				break;
-			}
-		}
-
-		// Record values default to `nil`.
-		if (j == num_keys) record->values[i] = kh_nil;
+	for (int j = 0; keys[j]; j++) {
+		long slot = kh_record_type_key_index(type, keys[j]);
+
+		if (slot != -1) record->values[slot] = values[j];
 	}
 
 	return (KhValue*) record;
@@ -111,31 +163,38 @@ const KhRecordType* kh_record_get_type(const KhRecord *record) {
 	return (KhRecordType*) KH_VALUE_TYPE(record);
 }
 
-// Both setting and getting values in records work basically the same way; the key is searched for
-// in the record type's key list, and the matching value is set/returned.
+// Both setting and getting values in records work basically the same way; the key is resolved to
+// a slot through the type's key index, and the matching value is set/returned.
+//
+// Callers that access the same field repeatedly should resolve the key to its slot once with
+// `kh_record_type_key_index` and use the `_indexed` variants, which are a bare array access.
 bool kh_record_set(KhRecord *record, const char *key, KhValue *value) {
 	const KhRecordType *type = (KhRecordType*) KH_VALUE_TYPE(record);
+	long slot = kh_record_type_key_index(type, key);
 
-	for (int i = 0; i < type->num_keys; i++) {
-		if (strcmp(type->keys[i], key) == 0) {
-			record->values[i] = value;
-			return true;
-		}
-	}
-	
-	return false;
+	if (slot == -1) return false;
+
+	record->values[slot] = value;
+	return true;
 }
 
 KhValue* kh_record_get(const KhRecord *record, const char *key) {
 	const KhRecordType *type = (KhRecordType*) KH_VALUE_TYPE(record);
+	long slot = kh_record_type_key_index(type, key);
 
-	for (int i = 0; i < type->num_keys; i++) {
-		if (strcmp(type->keys[i], key) == 0) {
-			return record->values[i];
-		}
-	}
-	
-	return NULL;
+	return slot == -1 ? NULL : record->values[slot];
+}
+
+void kh_record_set_indexed(KhRecord *record, long index, KhValue *value) {
+	assert(0 <= index && index < ((KhRecordType*) KH_VALUE_TYPE(record))->num_keys);
+
+	record->values[index] = value;
+}
+
+KhValue* kh_record_get_indexed(const KhRecord *record, long index) {
+	assert(0 <= index && index < ((KhRecordType*) KH_VALUE_TYPE(record))->num_keys);
+
+	return record->values[index];
 }
 
 bool kh_record_foreach(const KhRecord *record, bool (*callback)(const char*, const KhValue*, void*), void *userdata) {
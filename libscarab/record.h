@@ -5,10 +5,21 @@
 
 #include "value.h"
 
+struct _KhFunc;
+
 typedef struct _KhRecordType KhRecordType;
 
 KhValue* kh_record_type_new(const char**keys);
 long kh_record_type_get_num_keys(const KhRecordType *type);
+// Resolves a key to its slot in records of this type (or -1 if the type has no such key). The
+// result is stable for the life of the type, so it can be computed once and reused with the
+// `_indexed` accessors below.
+long kh_record_type_key_index(const KhRecordType *type, const char *key);
+
+// The type's direct method-dispatch slot array (see `kh_method_add` in eval.c, which owns the
+// indexing scheme). Passing a non-zero size allocates the array on first use; with zero, NULL is
+// returned if it was never allocated.
+struct _KhFunc** kh_record_type_method_slots(KhRecordType *type, long size);
 
 typedef struct _KhRecord KhRecord;
 
@@ -17,6 +28,8 @@ KhValue* kh_record_new_from_values(const KhRecordType *type, KhValue* const *val
 const KhRecordType* kh_record_get_type(const KhRecord *record);
 bool kh_record_set(KhRecord *record, const char *key, KhValue *value);
 KhValue* kh_record_get(const KhRecord *record, const char *key);
+void kh_record_set_indexed(KhRecord *record, long index, KhValue *value);
+KhValue* kh_record_get_indexed(const KhRecord *record, long index);
 bool kh_record_foreach(const KhRecord *record, bool (*callback)(const char*, const KhValue*, void*), void *userdata);
 
 #endif
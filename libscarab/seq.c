@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2015 Jesse Weaver <pianohacker@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Lazy sequences. List processing through cells is eager - every stage of a pipeline materializes
+// its whole output - so filtering and transforming a large dataset allocates every intermediate
+// list in full. A sequence instead produces one element each time it is pulled from, so a chain of
+// transformers runs in O(1) memory and computes nothing past the last element actually consumed.
+//
+// Each sequence is a pull function plus whatever state it needs; transformers hold their source
+// sequence and pull from it on demand. Already-produced elements are not retained, so a consumed
+// prefix can be collected even while the sequence is still live.
+
+#include <gc.h>
+#include <glib.h>
+#include <stdbool.h>
+
+#include "seq.h"
+#include "value.h"
+
+struct _KhSeq {
+	KhValue base;
+
+	// Fills `*value` with the next element (NULL when exhausted); returns false on error. Never
+	// called again once the sequence is exhausted or has failed; `kh_seq_next` handles that.
+	bool (*next)(KhContext *ctx, KhSeq *self, KhValue **value);
+
+	// State; which fields are used depends on `next`.
+	KhValue *cursor;
+	KhSeq *source;
+	KhFunc *func;
+	long counter;
+	long limit;
+
+	bool done;
+};
+
+static KhSeq* _seq_new(bool (*next)(KhContext*, KhSeq*, KhValue**)) {
+	KhSeq *seq = _KH_NEW_BASIC(KH_SEQ_TYPE, KhSeq);
+	seq->next = next;
+
+	return seq;
+}
+
+// # Sources
+
+static bool _list_next(KhContext *ctx, KhSeq *self, KhValue **value) {
+	if (KH_IS_CELL(self->cursor)) {
+		*value = KH_CELL(self->cursor)->left;
+		self->cursor = KH_CELL(self->cursor)->right;
+	} else {
+		*value = NULL;
+	}
+
+	return true;
+}
+
+KhValue* kh_seq_from_list(KhValue *list) {
+	KhSeq *seq = _seq_new(_list_next);
+	seq->cursor = list;
+
+	return (KhValue*) seq;
+}
+
+static bool _range_next(KhContext *ctx, KhSeq *self, KhValue **value) {
+	// Elements are almost always immediate ints, so even a huge range allocates nothing.
+	*value = self->counter < self->limit ? kh_int_new(self->counter++) : NULL;
+
+	return true;
+}
+
+KhValue* kh_seq_range(long from, long to) {
+	KhSeq *seq = _seq_new(_range_next);
+	seq->counter = from;
+	seq->limit = to;
+
+	return (KhValue*) seq;
+}
+
+// # Transformers
+
+static bool _map_next(KhContext *ctx, KhSeq *self, KhValue **value) {
+	KhValue *elem;
+	if (!kh_seq_next(ctx, self->source, &elem)) return false;
+
+	if (!elem) {
+		*value = NULL;
+		return true;
+	}
+
+	*value = kh_apply_values(ctx, self->func, 1, &elem);
+	return *value != NULL;
+}
+
+KhValue* kh_seq_map(KhSeq *source, KhFunc *func) {
+	KhSeq *seq = _seq_new(_map_next);
+	seq->source = source;
+	seq->func = func;
+
+	return (KhValue*) seq;
+}
+
+static bool _filter_next(KhContext *ctx, KhSeq *self, KhValue **value) {
+	KhValue *elem;
+
+	// Pull until the predicate passes an element through (nil is false, anything else true, as
+	// elsewhere in the language).
+	while (true) {
+		if (!kh_seq_next(ctx, self->source, &elem)) return false;
+
+		if (!elem) {
+			*value = NULL;
+			return true;
+		}
+
+		KhValue *keep = kh_apply_values(ctx, self->func, 1, &elem);
+		if (!keep) return false;
+
+		if (!KH_IS_NIL(keep)) {
+			*value = elem;
+			return true;
+		}
+	}
+}
+
+KhValue* kh_seq_filter(KhSeq *source, KhFunc *func) {
+	KhSeq *seq = _seq_new(_filter_next);
+	seq->source = source;
+	seq->func = func;
+
+	return (KhValue*) seq;
+}
+
+static bool _take_next(KhContext *ctx, KhSeq *self, KhValue **value) {
+	if (self->counter >= self->limit) {
+		// Cut off without pulling, so the source never computes elements past the limit.
+		*value = NULL;
+		return true;
+	}
+
+	if (!kh_seq_next(ctx, self->source, value)) return false;
+	if (*value) self->counter++;
+
+	return true;
+}
+
+KhValue* kh_seq_take(KhSeq *source, long count) {
+	KhSeq *seq = _seq_new(_take_next);
+	seq->source = source;
+	seq->limit = count;
+
+	return (KhValue*) seq;
+}
+
+// # Pulling
+
+bool kh_seq_next(KhContext *ctx, KhSeq *seq, KhValue **value) {
+	if (seq->done) {
+		*value = NULL;
+		return true;
+	}
+
+	if (!seq->next(ctx, seq, value)) {
+		// A failed sequence stays failed; nothing more will be pulled from it.
+		seq->done = true;
+		return false;
+	}
+
+	if (!*value) {
+		seq->done = true;
+		// Allow everything upstream (and the last elements) to be collected.
+		seq->cursor = NULL;
+		seq->source = NULL;
+		seq->func = NULL;
+	}
+
+	return true;
+}
@@ -0,0 +1,25 @@
+#ifndef __SEQ_H__
+#define __SEQ_H__
+
+#include <stdbool.h>
+
+#include "eval.h"
+#include "value.h"
+
+typedef struct _KhSeq KhSeq;
+
+// Sources.
+KhValue* kh_seq_from_list(KhValue *list);
+// Yields the integers from `from` (inclusive) to `to` (exclusive).
+KhValue* kh_seq_range(long from, long to);
+
+// Transformers; all O(1), deferring any calls into `func` until the result is pulled from.
+KhValue* kh_seq_map(KhSeq *source, KhFunc *func);
+KhValue* kh_seq_filter(KhSeq *source, KhFunc *func);
+KhValue* kh_seq_take(KhSeq *source, long count);
+
+// Pulls the next element. Returns false if producing it failed (the error is pending on the
+// context); otherwise `*value` holds the element, or NULL if the sequence is exhausted.
+bool kh_seq_next(KhContext *ctx, KhSeq *seq, KhValue **value);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015 Jesse Weaver <pianohacker@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Symbol lookup is the hottest operation in the evaluator, and every symbol name passes through
+// interning on its way into a scope, method table or record type. `g_intern_string` gives back
+// pointer-unique names but keeps its bookkeeping to itself, so anything wanting a hash of the name
+// had to re-hash the string. Here each interned name is stored immediately after a small header
+// holding its content hash and a dense sequential ID, both retrievable from the pointer in O(1).
+
+#include <glib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "symbol.h"
+
+// The header sits directly before the name's characters in the same allocation, so the accessors
+// are a single backwards pointer step.
+typedef struct {
+	unsigned int hash;
+	long id;
+	char name[];
+} _InternEntry;
+
+#define _ENTRY(interned) ((_InternEntry*) ((interned) - offsetof(_InternEntry, name)))
+
+// The table itself is an open-addressed, power-of-two-sized array of entries, kept at most half
+// full. Interned names live forever (that is the point of interning), so entries are plain
+// `g_malloc` allocations and there is no deletion.
+static _InternEntry **_table = NULL;
+static long _table_size = 0;
+static long _count = 0;
+
+// Interning happens from multiple threads (`parallel-map` workers define symbols in their own
+// contexts); lookups of already-interned pointers via the accessors are lock-free.
+static GMutex _lock;
+
+static long _probe(unsigned int hash, const char *name) {
+	long mask = _table_size - 1;
+
+	long i = hash & mask;
+	while (_table[i] && !(_table[i]->hash == hash && strcmp(_table[i]->name, name) == 0))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static void _grow() {
+	_InternEntry **old_table = _table;
+	long old_size = _table_size;
+
+	_table_size = _table_size ? _table_size * 2 : 256;
+	_table = g_malloc0(sizeof(_InternEntry*) * _table_size);
+
+	for (long i = 0; i < old_size; i++) {
+		if (old_table[i]) _table[_probe(old_table[i]->hash, old_table[i]->name)] = old_table[i];
+	}
+
+	g_free(old_table);
+}
+
+const char* kh_intern(const char *name) {
+	unsigned int hash = g_str_hash(name);
+
+	g_mutex_lock(&_lock);
+
+	if (_count * 2 >= _table_size) _grow();
+
+	long i = _probe(hash, name);
+
+	if (!_table[i]) {
+		long length = strlen(name);
+		_InternEntry *entry = g_malloc(sizeof(_InternEntry) + length + 1);
+		entry->hash = hash;
+		entry->id = _count++;
+		memcpy(entry->name, name, length + 1);
+
+		_table[i] = entry;
+	}
+
+	const char *result = _table[i]->name;
+
+	g_mutex_unlock(&_lock);
+
+	return result;
+}
+
+unsigned int kh_intern_hash(const char *interned) {
+	return _ENTRY(interned)->hash;
+}
+
+long kh_intern_id(const char *interned) {
+	return _ENTRY(interned)->id;
+}
+
+long kh_intern_count() {
+	return _count;
+}
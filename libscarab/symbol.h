@@ -0,0 +1,20 @@
+#ifndef __SYMBOL_H__
+#define __SYMBOL_H__
+
+// libscarab's own string interner. Like `g_intern_string`, `kh_intern` maps equal strings to a
+// single canonical pointer, but it also stores a precomputed hash and a small sequential ID
+// alongside each name, so code holding an interned pointer never has to re-hash the string.
+//
+// The two interners do not mix: the accessors below read bookkeeping stored next to the name, so
+// they must only be given pointers that came from `kh_intern`.
+
+const char* kh_intern(const char *name);
+
+// The name's content hash, computed once at intern time.
+unsigned int kh_intern_hash(const char *interned);
+// A small, dense, stable ID (0, 1, 2, ...), usable as an array index.
+long kh_intern_id(const char *interned);
+// One more than the largest ID handed out so far; useful for sizing such arrays.
+long kh_intern_count();
+
+#endif
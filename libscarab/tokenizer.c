@@ -53,10 +53,13 @@ static char *TOKEN_NAMES[4] = {
 // Most of this is prosaic state information.
 struct _KhTokenizer {
 	char *filename;
-	GIOChannel *channel;
+	// For file input, the entire contents, read up front in a single block (and freed by the
+	// finalizer); scanning then never leaves memory. NULL for string input, where the caller owns
+	// the buffer.
+	char *contents;
 	const char *str_base;
 	const char *str;
-	
+
 	int line;
 	int col;
 
@@ -67,12 +70,68 @@ struct _KhTokenizer {
 
 // GC finalizer for a tokenizer.
 void _tokenizer_finalize(KhTokenizer *self, void *data) {
-	if (self->channel) {
-		g_io_channel_shutdown(self->channel, FALSE, NULL);
-		g_io_channel_unref(self->channel);
+	if (self->contents) {
+		g_free(self->contents);
+		self->contents = NULL;
+	}
+}
+
+
+//> Byte classification
+//
+// Almost every input byte is an ASCII identifier character, digit or space, and classifying those
+// one decoded `gunichar` at a time (a UTF-8 decode plus several Unicode property calls each) is
+// the bulk of tokenizing cost. This table classifies a raw byte with a single load, so the
+// sub-tokenizers below can consume whole runs of ASCII bytes in a tight scan over the buffer and
+// only drop to the Unicode-aware path for non-ASCII bytes or when a peek is in flight.
+//
+// Each entry mirrors the decision the corresponding slow path makes for that byte; the fast paths
+// change where the work happens, never its outcome.
+#define _CLASS_SPACE 1
+#define _CLASS_DIGIT 2
+#define _CLASS_ALNUM 4
+#define _CLASS_IDENT 8
+
+static guint8 _byte_class[256];
+
+static gpointer _byte_class_init(gpointer data) {
+	// Bytes >= 128 (UTF-8 continuations and lead bytes) and NUL stay zero, stopping every scan.
+	for (int b = 1; b < 128; b++) {
+		if (b == ' ' || b == '\t' || b == '\r') _byte_class[b] |= _CLASS_SPACE;
+		if (isdigit(b)) _byte_class[b] |= _CLASS_DIGIT;
+		if (isalpha(b) || isdigit(b)) _byte_class[b] |= _CLASS_ALNUM;
+		// The identifier-interior set: see the condition in `_tokenize_identifier`.
+		if ((isalpha(b) || isdigit(b) || ispunct(b)) && !strchr(KH_TOKENIZER_SPECIAL_PUNCT, b))
+			_byte_class[b] |= _CLASS_IDENT;
 	}
+
+	return NULL;
+}
+
+static void _ensure_byte_class() {
+	static GOnce once = G_ONCE_INIT;
+	g_once(&once, _byte_class_init, NULL);
 }
 
+// Consumes the run of buffer bytes matching `class_mask` and returns its start and `*length`.
+// Only valid to call when no peek is in flight; a NULL return means the fast path can't run (or
+// the run is empty) and the caller should fall through to its per-character loop.
+static const char* _scan_run(KhTokenizer *self, guint8 class_mask, long *length) {
+	if (self->peek_avail || !self->str) return NULL;
+
+	const char *run = self->str;
+	while (_byte_class[(guchar) *run] & class_mask) run++;
+
+	*length = run - self->str;
+	if (*length == 0) return NULL;
+
+	// Runs never contain newlines, so column tracking is a single add.
+	const char *start = self->str;
+	self->col += *length;
+	self->str = run;
+
+	return start;
+}
 
 // ## Public API
 
@@ -86,14 +145,30 @@ void _tokenizer_finalize(KhTokenizer *self, void *data) {
  * Returns: A new %KhTokenizer, or NULL on failure.
  */
 KhTokenizer* kh_tokenizer_new(const char *filename, GError **err) {
+	_ensure_byte_class();
+
 	KhTokenizer *self = GC_NEW(KhTokenizer);
-	GC_REGISTER_FINALIZER(self, (GC_finalization_proc) _tokenizer_finalize, NULL, NULL, NULL);
 	self->filename = GC_STRDUP(filename);
-	self->channel = g_io_channel_new_file(filename, "r", err);
 
-	if (!self->channel) return NULL;
+	// The file is read into memory in one go rather than through a GIOChannel; this costs a
+	// buffer the size of the file, but means tokenizing pays no per-character I/O calls.
+	gsize length;
+	if (!g_file_get_contents(filename, &self->contents, &length, err)) return NULL;
+
+	GC_REGISTER_FINALIZER(self, (GC_finalization_proc) _tokenizer_finalize, NULL, NULL, NULL);
+
+	if (!g_utf8_validate(self->contents, length, NULL)) {
+		g_set_error(
+			err,
+			G_CONVERT_ERROR,
+			G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+			"Invalid UTF-8 sequence in %s",
+			filename
+		);
+		return NULL;
+	}
 
-	self->str_base = self->str = NULL;
+	self->str_base = self->str = self->contents;
 	self->line = 1;
 	self->col = 1;
 	self->peek_avail = false;
@@ -111,9 +186,12 @@ KhTokenizer* kh_tokenizer_new(const char *filename, GError **err) {
  * Returns: A new %KhTokenizer, or NULL on failure.
  */
 KhTokenizer* kh_tokenizer_new_from_string(const char *str, GError **err) {
+	_ensure_byte_class();
+
 	KhTokenizer *self = GC_NEW(KhTokenizer);
 	GC_REGISTER_FINALIZER(self, (GC_finalization_proc) _tokenizer_finalize, NULL, NULL, NULL);
 	self->filename = "<string>";
+	self->contents = NULL;
 	self->str_base = self->str = str;
 
 	if (!g_utf8_validate(self->str, -1, NULL)) {
@@ -126,7 +204,6 @@ KhTokenizer* kh_tokenizer_new_from_string(const char *str, GError **err) {
 		return NULL;
 	}
 
-	self->channel = NULL;
 	self->line = 1;
 	self->col = 1;
 	self->peek_avail = false;
@@ -183,31 +260,14 @@ static bool _read(KhTokenizer *self, gunichar *result, GError **err) {
 		if (!*self->str) {
 			self->str = NULL;
 			*result = EOF;
-		} else {
-			*result = g_utf8_get_char(self->str);
-			self->str = g_utf8_next_char(self->str);
+			return true;
 		}
 
-		return true;
+		*result = g_utf8_get_char(self->str);
+		self->str = g_utf8_next_char(self->str);
 	} else {
-		if (G_UNLIKELY(!self->channel)) return false;
-
-		switch (g_io_channel_read_unichar(self->channel, result, err)) {
-			case G_IO_STATUS_ERROR:
-				self->channel = NULL;
-				self->peek_avail = false;
-				return false;
-			case G_IO_STATUS_EOF:
-				self->peek_avail = false;
-				*result = EOF;
-				g_io_channel_shutdown(self->channel, FALSE, NULL);
-				g_io_channel_unref(self->channel);
-				self->channel = NULL;
-				return true;
-			case G_IO_STATUS_AGAIN:
-			case G_IO_STATUS_NORMAL:
-				break;
-		}
+		*result = EOF;
+		return true;
 	}
 
 	if (*result == '\n') {
@@ -233,34 +293,14 @@ static bool _read(KhTokenizer *self, gunichar *result, GError **err) {
  */
 static bool _peek(KhTokenizer *self, gunichar *result, GError **err) {
 	if (!self->peek_avail) {
-		if (self->str) {
-			if (*self->str) {
-				self->peeked = g_utf8_get_char(self->str);
-				self->str = g_utf8_next_char(self->str);
-			} else {
-				self->str = NULL;
-				self->peeked = EOF;
-			}
-			self->peek_avail = true;
+		if (self->str && *self->str) {
+			self->peeked = g_utf8_get_char(self->str);
+			self->str = g_utf8_next_char(self->str);
 		} else {
-			if (self->channel == NULL) return false;
-
-			switch (g_io_channel_read_unichar(self->channel, &(self->peeked), err)) {
-				case G_IO_STATUS_ERROR:
-					self->channel = NULL;
-					self->peek_avail = false;
-					return false;
-				case G_IO_STATUS_EOF:
-					self->peeked = EOF;
-					g_io_channel_shutdown(self->channel, FALSE, NULL);
-					g_io_channel_unref(self->channel);
-					self->channel = NULL;
-				case G_IO_STATUS_AGAIN:
-				case G_IO_STATUS_NORMAL:
-				default:
-					self->peek_avail = true;
-			}
+			self->str = NULL;
+			self->peeked = EOF;
 		}
+		self->peek_avail = true;
 	}
 
 	*result = self->peeked;
@@ -326,7 +366,21 @@ static bool _tokenize_number(KhTokenizer *self, KhToken *result, gunichar c, GEr
 	output[0] = c;
 	int i = 1;
 
-	while (_peek(self, &c, err) && c < 256 && isdigit(c)) {
+	while (true) {
+		// Bulk path: grab the whole run of ASCII digits in one scan and copy.
+		long run_length;
+		const char *run = _scan_run(self, _CLASS_DIGIT, &run_length);
+
+		if (run) {
+			while (i + run_length + 1 >= result->val_length) GROW_IF_NEEDED(output = result->val, i + run_length + 1, result->val_length);
+
+			memcpy(output + i, run, run_length);
+			i += run_length;
+			continue;
+		}
+
+		if (!(_peek(self, &c, err) && c < 256 && isdigit(c))) break;
+
 		GROW_IF_NEEDED(output = result->val, i + 1, result->val_length);
 
 		_consume(self);
@@ -337,7 +391,20 @@ static bool _tokenize_number(KhTokenizer *self, KhToken *result, gunichar c, GEr
 
 	char *suffix = output + i;
 
-	while (_peek(self, &c, err) && c < 256 && (isalpha(c) || isdigit(c))) {
+	while (true) {
+		long run_length;
+		const char *run = _scan_run(self, _CLASS_ALNUM, &run_length);
+
+		if (run) {
+			while (i + run_length + 1 >= result->val_length) GROW_IF_NEEDED(output = result->val, i + run_length + 1, result->val_length);
+
+			memcpy(output + i, run, run_length);
+			i += run_length;
+			continue;
+		}
+
+		if (!(_peek(self, &c, err) && c < 256 && (isalpha(c) || isdigit(c)))) break;
+
 		GROW_IF_NEEDED(output = result->val, i + 1, result->val_length);
 
 		_consume(self);
@@ -359,10 +426,25 @@ static bool _tokenize_identifier(KhTokenizer *self, KhToken *result, gunichar c,
 	GROW_IF_NEEDED(output = result->val, 5, result->val_length);
 	int i = g_unichar_to_utf8(c, output);
 
-	while (_peek(self, &c, err) &&
-			!(c < 256 && strchr(KH_TOKENIZER_SPECIAL_PUNCT, (char) c)) &&
-			(c == '_' || c == '-' || g_unichar_isalpha(c) || g_unichar_isdigit(c) || g_unichar_ispunct(c))
-		) {
+	while (true) {
+		// Bulk path: grab the whole run of ASCII identifier bytes in one scan and copy; the
+		// Unicode-aware check below only ever sees non-ASCII (or special) characters.
+		long run_length;
+		const char *run = _scan_run(self, _CLASS_IDENT, &run_length);
+
+		if (run) {
+			while (i + run_length + 5 >= result->val_length) GROW_IF_NEEDED(output = result->val, i + run_length + 5, result->val_length);
+
+			memcpy(output + i, run, run_length);
+			i += run_length;
+			continue;
+		}
+
+		if (!(_peek(self, &c, err) &&
+				!(c < 256 && strchr(KH_TOKENIZER_SPECIAL_PUNCT, (char) c)) &&
+				(c == '_' || c == '-' || g_unichar_isalpha(c) || g_unichar_isdigit(c) || g_unichar_ispunct(c))
+			)) break;
+
 		GROW_IF_NEEDED(output = result->val, i + 5, result->val_length);
 
 		_consume(self);
@@ -442,8 +524,9 @@ static bool _tokenize_backquote_string(KhTokenizer *self, KhToken *result, GErro
  * @result: (out callee-allocates): A %KhToken to initialize and fill in.
  * @err: (out) (allow-none): Location to store any error, may be %NULL.
  *
- * Fetches the next token from the input. Depending on the source of input, may set an error in one
- * of the %KH_SYNTAX_ERROR, %G_IO_CHANNEL_ERROR, or %G_CONVERT_ERROR domains.
+ * Fetches the next token from the input. May set an error in the %KH_SYNTAX_ERROR domain. (I/O and
+ * encoding problems are reported by kh_tokenizer_new()/kh_tokenizer_new_from_string(), as the
+ * input is read up front.)
  *
  * Returns: Whether a token could be successfully read.
  */
@@ -453,6 +536,13 @@ bool kh_tokenizer_next(KhTokenizer *self, KhToken *result, GError **err) {
 	int col;
 
 	retry:
+	// Runs of spaces, tabs and CRs between tokens are skipped in bulk; the `' '` case below only
+	// handles whitespace that was already peeked.
+	{
+		long run_length;
+		_scan_run(self, _CLASS_SPACE, &run_length);
+	}
+
 	line = self->line;
 	col = self->col;
 	if (!_read(self, &c, err)) return false;
@@ -20,12 +20,15 @@
 #include <gc.h>
 #include <glib.h>
 #include <stdbool.h>
+#include <string.h>
 
 // We have to include this first due to some circular-reference mess in the struct definitions.
 #include "value.h"
 
 #include "eval.h"
+#include "map.h"
 #include "record.h"
+#include "symbol.h"
 
 static char *_value_type_names[] = {
 	"nil",
@@ -36,6 +39,9 @@ static char *_value_type_names[] = {
 	"func",
 	"quoted",
 	"record-type",
+	"vector",
+	"map",
+	"seq",
 };
 
 /*const char *kh_value_type_name(KhValueType type) {*/
@@ -47,12 +53,15 @@ KhValue* kh_nil = NULL;
 KhValue* kh_nil_new() {
 	assert(kh_nil == NULL);
 
-	return _KH_NEW_BASIC(KH_NIL_TYPE, KhValue);
+	// Nil is an immediate, so this allocates nothing; the function remains so embedders (and the
+	// context setup) have a single place that produces the canonical nil.
+	return KH_IMMEDIATE_NIL;
 }
 
 KhValue* kh_string_new_take(char *val) {
 	KhString *str = _KH_NEW_BASIC(KH_STRING_TYPE, KhString);
 	str->value = val;
+	str->length = strlen(val);
 
 	return (KhValue *) str;
 }
@@ -61,7 +70,68 @@ KhValue* kh_string_new(const char *val) {
 	return kh_string_new_take(GC_STRDUP(val));
 }
 
+KhValue* kh_string_new_len(const char *val, long length) {
+	KhString *str = _KH_NEW_BASIC(KH_STRING_TYPE, KhString);
+	// The string's contents may contain NULs this way, but the copy is still NUL-terminated for
+	// C-string consumers.
+	str->value = GC_MALLOC_ATOMIC(length + 1);
+	memcpy(str->value, val, length);
+	str->value[length] = '\0';
+	str->length = length;
+
+	return (KhValue *) str;
+}
+
+// Concatenation works like an inside-out string builder. The result owns a buffer with spare
+// capacity, and concatenating onto it again extends that buffer in place, so a chain of
+// concatenations (the usual way large output gets built) costs O(total length) rather than
+// O(length²) of copying.
+//
+// Strings are never mutated: an extension only writes past the buffer's high-water mark, and only
+// the string whose contents end exactly at that mark (in the buffer's current allocation) can
+// extend it. Everything else falls back to a fresh buffer.
+KhValue* kh_string_concat(KhString *left, KhString *right) {
+	long length = left->length + right->length;
+
+	KhStringBuffer *buffer = left->buffer;
+
+	if (buffer && left->value == buffer->data && left->length == buffer->used) {
+		if (length + 1 > buffer->capacity) {
+			while (length + 1 > buffer->capacity) buffer->capacity *= 2;
+
+			// Growth must not `GC_REALLOC`: that frees the old block if it moves, dangling every
+			// earlier string that shares it. A fresh block leaves the old one to strings still
+			// pointing at it (which keep it alive), and they no longer match `buffer->data` above.
+			char *data = GC_MALLOC_ATOMIC(buffer->capacity);
+			memcpy(data, buffer->data, buffer->used);
+			buffer->data = data;
+		}
+	} else {
+		buffer = GC_NEW(KhStringBuffer);
+		buffer->capacity = MAX(length + 1, 64) * 2;
+		buffer->data = GC_MALLOC_ATOMIC(buffer->capacity);
+
+		memcpy(buffer->data, left->value, left->length);
+		buffer->used = left->length;
+	}
+
+	memcpy(buffer->data + buffer->used, right->value, right->length);
+	buffer->used = length;
+	buffer->data[length] = '\0';
+
+	KhString *str = _KH_NEW_BASIC(KH_STRING_TYPE, KhString);
+	str->value = buffer->data;
+	str->length = length;
+	str->buffer = buffer;
+
+	return (KhValue *) str;
+}
+
 KhValue* kh_int_new(long val) {
+	// Almost every integer fits in an immediate, in which case no allocation happens at all; only
+	// values that would lose their top bit to the tag fall back to a heap `KhInt`.
+	if (KH_INT_FITS_IMMEDIATE(val)) return _KH_IMMEDIATE_INT(val);
+
 	KhInt *int_ = _KH_NEW_BASIC(KH_INT_TYPE, KhInt);
 	int_->value = val;
 
@@ -76,9 +146,46 @@ KhValue* kh_cell_new(KhValue *left, KhValue *right) {
 	return (KhValue *) cell;
 }
 
+// # Cell arenas
+
+struct _KhCellArena {
+	KhCell *slab;
+	long used;
+	long slab_size;
+};
+
+KhCellArena* kh_cell_arena_new(long cells_per_slab) {
+	KhCellArena *arena = GC_NEW(KhCellArena);
+	arena->slab_size = cells_per_slab > 0 ? cells_per_slab : 1024;
+	// Forces a slab allocation at the first cell.
+	arena->used = arena->slab_size;
+
+	return arena;
+}
+
+KhValue* kh_cell_new_in(KhCellArena *arena, KhValue *left, KhValue *right) {
+	if (!arena) return kh_cell_new(left, right);
+
+	if (arena->used == arena->slab_size) {
+		// Slabs come from GC_MALLOC, and the collector considers interior pointers, so any
+		// reachable cell keeps its whole slab alive; the arena doesn't need to track old slabs.
+		arena->slab = GC_MALLOC(sizeof(KhCell) * arena->slab_size);
+		arena->used = 0;
+	}
+
+	KhCell *cell = &arena->slab[arena->used++];
+	((KhValue*) cell)->type = (KhValue*) KH_CELL_TYPE;
+	cell->left = left;
+	cell->right = right;
+
+	return (KhValue*) cell;
+}
+
 KhValue* kh_symbol_new(const char *val) {
 	KhSymbol *symbol = _KH_NEW_BASIC(KH_SYMBOL_TYPE, KhSymbol);
-	symbol->value = (char *) g_intern_string(val);
+	symbol->value = kh_intern(val);
+	symbol->hash = kh_intern_hash(symbol->value);
+	symbol->id = kh_intern_id(symbol->value);
 
 	return (KhValue *) symbol;
 }
@@ -90,97 +197,184 @@ KhValue* kh_quoted_new(KhValue *val) {
 	return (KhValue *) quoted;
 }
 
+KhValue* kh_vector_new(long capacity) {
+	KhVector *vector = _KH_NEW_BASIC(KH_VECTOR_TYPE, KhVector);
+	vector->length = 0;
+	vector->capacity = capacity > 0 ? capacity : 4;
+	vector->values = GC_MALLOC(sizeof(KhValue*) * vector->capacity);
+
+	return (KhValue *) vector;
+}
+
+void kh_vector_append(KhVector *vector, KhValue *val) {
+	if (vector->length == vector->capacity) {
+		vector->capacity *= 2;
+		vector->values = GC_REALLOC(vector->values, sizeof(KhValue*) * vector->capacity);
+	}
+
+	vector->values[vector->length++] = val;
+}
+
+// Inspection renders through a writer, so nothing below ever has to hold more than one chunk of
+// the output in memory; `kh_inspect` is just the writer that happens to collect into a `GString`.
+
+static void _write_str(KhWriter *writer, const char *str) {
+	writer->write(str, strlen(str), writer->userdata);
+}
+
+static void _write_char(KhWriter *writer, char c) {
+	writer->write(&c, 1, writer->userdata);
+}
+
 // For _inspect_cell
-static void _inspect(const KhValue *value, GString *result);
+static void _inspect(const KhValue *value, KhWriter *writer);
 
-static void _inspect_int(const KhInt *int_, GString *result) {
-	g_string_append_printf(result, "%ld", int_->value);
+static void _inspect_int(const KhValue *value, KhWriter *writer) {
+	// More than enough for any long.
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%ld", KH_INT_VALUE(value));
+	_write_str(writer, buf);
 }
 
-static void _inspect_string(const KhString *string, GString *result) {
+static void _inspect_string(const KhString *string, KhWriter *writer) {
 	char *repr = g_strescape(string->value, "");
-	g_string_append_c(result, '"');
-	g_string_append(result, repr);
-	g_string_append_c(result, '"');
+	_write_char(writer, '"');
+	_write_str(writer, repr);
+	_write_char(writer, '"');
 	g_free(repr);
 }
 
-static void _inspect_cell(const KhCell *cell, GString *result, bool in_cell) {
-	if (!in_cell) g_string_append_c(result, '(');
+static void _inspect_cell(const KhCell *cell, KhWriter *writer, bool in_cell) {
+	if (!in_cell) _write_char(writer, '(');
 
 	if (KH_IS_CELL(cell->right)) {
-		_inspect(cell->left, result);
-		g_string_append_c(result, ' ');
-		_inspect_cell(KH_CELL(cell->right), result, true);
+		_inspect(cell->left, writer);
+		_write_char(writer, ' ');
+		_inspect_cell(KH_CELL(cell->right), writer, true);
 	} else if (cell->right == kh_nil) {
-		_inspect(cell->left, result);
+		_inspect(cell->left, writer);
 	} else {
-		_inspect(cell->left, result);
-		g_string_append(result, " . ");
-		_inspect(cell->right, result);
+		_inspect(cell->left, writer);
+		_write_str(writer, " . ");
+		_inspect(cell->right, writer);
+	}
+
+	if (!in_cell) _write_char(writer, ')');
+}
+
+static void _inspect_func(const KhFunc *func, KhWriter *writer) {
+	_write_str(writer, "*function \"");
+	_write_str(writer, kh_func_get_name(func));
+	_write_str(writer, "\"*");
+}
+
+static void _inspect_vector(const KhVector *vector, KhWriter *writer) {
+	_write_str(writer, "(*vector");
+
+	for (long i = 0; i < vector->length; i++) {
+		_write_char(writer, ' ');
+		_inspect(vector->values[i], writer);
 	}
 
-	if (!in_cell) g_string_append_c(result, ')');
+	_write_char(writer, ')');
 }
 
-static void _inspect_func(const KhFunc *func, GString *result) {
-	g_string_append_printf(result, "*function \"%s\"*", kh_func_get_name(func));
+static bool _inspect_map_pair_cb(const char *key, KhValue *value, void *userdata) {
+	KhWriter *writer = (KhWriter*) userdata;
+
+	_write_char(writer, ' ');
+	_write_str(writer, key);
+	_write_char(writer, ' ');
+	_inspect(value, writer);
+
+	return true;
 }
 
 static bool _inspect_record_pair_cb(const char *key, const KhValue *value, void *userdata) {
-	GString *result = (GString*) userdata;
+	KhWriter *writer = (KhWriter*) userdata;
 
-	g_string_append_c(result, ' ');
-	g_string_append(result, key);
-	g_string_append_c(result, ' ');
-	_inspect(value, result);
+	_write_char(writer, ' ');
+	_write_str(writer, key);
+	_write_char(writer, ' ');
+	_inspect(value, writer);
 
 	return true;
 }
 
-static void _inspect(const KhValue *value, GString *result) {
+static void _inspect(const KhValue *value, KhWriter *writer) {
 	if (KH_IS_BASIC(value)) {
-		switch (KH_BASIC_TYPE(value->type)) {
+		switch (KH_BASIC_TYPE(KH_VALUE_TYPE(value))) {
 			case KH_NIL_TYPE:
-				g_string_append(result, "nil");
+				_write_str(writer, "nil");
 				break;
 			case KH_INT_TYPE:
-				_inspect_int(KH_INT(value), result);
+				_inspect_int(value, writer);
 				break;
 			case KH_STRING_TYPE:
-				_inspect_string(KH_STRING(value), result);
+				_inspect_string(KH_STRING(value), writer);
 				break;
 			case KH_CELL_TYPE:
-				_inspect_cell(KH_CELL(value), result, false);
+				_inspect_cell(KH_CELL(value), writer, false);
 				break;
 			case KH_SYMBOL_TYPE:
-				g_string_append(result, KH_SYMBOL(value)->value);
+				_write_str(writer, KH_SYMBOL(value)->value);
 				break;
 			case KH_FUNC_TYPE:
-				_inspect_func(KH_FUNC(value), result);
+				_inspect_func(KH_FUNC(value), writer);
 				break;
 			case KH_QUOTED_TYPE:
-				g_string_append(result, "(quote ");
-				_inspect(KH_QUOTED(value)->value, result);
-				g_string_append_c(result, ')');
+				_write_str(writer, "(quote ");
+				_inspect(KH_QUOTED(value)->value, writer);
+				_write_char(writer, ')');
 				break;
 			case KH_RECORD_TYPE_TYPE:
-				g_string_append(result, "*record-type*");
+				_write_str(writer, "*record-type*");
+				break;
+			case KH_VECTOR_TYPE:
+				_inspect_vector(KH_VECTOR(value), writer);
+				break;
+			case KH_SEQ_TYPE:
+				// Inspecting must not pull from the sequence, so there is nothing to show but the
+				// fact of it.
+				_write_str(writer, "*seq*");
+				break;
+			case KH_MAP_TYPE:
+				// Note that the order of the pairs here is the table's, not insertion order.
+				_write_str(writer, "(*map");
+				kh_map_foreach(KH_MAP((KhValue*) value), _inspect_map_pair_cb, writer);
+				_write_char(writer, ')');
 				break;
 			default:
 				assert(0);
 		}
 	} else if (KH_IS_RECORD(value)) {
-		g_string_append(result, "(*record");
-		kh_record_foreach(KH_RECORD(value), _inspect_record_pair_cb, result);
-		g_string_append_c(result, ')');
+		_write_str(writer, "(*record");
+		kh_record_foreach(KH_RECORD(value), _inspect_record_pair_cb, writer);
+		_write_char(writer, ')');
 	}
 }
 
+void kh_inspect_to(const KhValue *value, KhWriter *writer) {
+	_inspect(value, writer);
+}
+
+static void _file_sink(const char *data, long length, void *userdata) {
+	fwrite(data, 1, length, (FILE*) userdata);
+}
+
+KhWriter kh_file_writer(FILE *file) {
+	return (KhWriter) { _file_sink, file };
+}
+
+static void _string_sink(const char *data, long length, void *userdata) {
+	g_string_append_len((GString*) userdata, data, length);
+}
+
 char* kh_inspect(const KhValue *value) {
 	GString *result = g_string_new("");
 
-	_inspect(value, result);
+	KhWriter writer = { _string_sink, result };
+	_inspect(value, &writer);
 
 	return g_string_free(result, FALSE);
 }
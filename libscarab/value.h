@@ -2,6 +2,8 @@
 #define __VALUE_H__
 
 #include <assert.h>
+#include <limits.h>
+#include <stdio.h>
 
 typedef enum {
 	KH_NIL_TYPE = 0,
@@ -12,15 +14,33 @@ typedef enum {
 	KH_FUNC_TYPE,
 	KH_QUOTED_TYPE,
 	KH_RECORD_TYPE_TYPE,
+	KH_VECTOR_TYPE,
+	KH_MAP_TYPE,
+	KH_SEQ_TYPE,
 	KH_NUM_BASIC_TYPES,
 } KhBasicType;
 
 #define KH_BASIC_TYPE(type) ((KhBasicType) type)
 #define KH_IS_TYPE(type) (KH_BASIC_TYPE(type) < KH_NUM_BASIC_TYPES || KH_IS_RECORD_TYPE(type))
 
-#define KH_VALUE_TYPE(val) (((KhValue*) val)->type)
-#define KH_IS(val, t) (((KhValue*) val)->type == (KhValue*) (t))
-#define KH_IS_BASIC(val) (KH_BASIC_TYPE(val->type) < KH_NUM_BASIC_TYPES)
+// # Immediate values
+//
+// Small integers and nil are not heap-allocated; they are packed directly into the `KhValue`
+// pointer. GC allocations are aligned to at least four bytes, so the low two bits of a real
+// pointer are always zero; a fixnum is stored shifted left one with the low bit set, and nil is
+// the fixed (non-pointer) value 2.
+//
+// Any macro that would dereference a value's `type` field has to check for an immediate first.
+#define _KH_TAG_MASK 3l
+#define KH_IS_IMMEDIATE(val) ((((long) (val)) & _KH_TAG_MASK) != 0)
+#define _KH_IMMEDIATE_TYPE(val) ((struct _KhValue*) (long) ((((long) (val)) & 1l) ? KH_INT_TYPE : KH_NIL_TYPE))
+#define KH_IMMEDIATE_NIL ((struct _KhValue*) 2l)
+#define _KH_IMMEDIATE_INT(v) ((struct _KhValue*) (((v) << 1) | 1l))
+#define KH_INT_FITS_IMMEDIATE(v) ((LONG_MIN >> 1) <= (v) && (v) <= (LONG_MAX >> 1))
+
+#define KH_VALUE_TYPE(val) (KH_IS_IMMEDIATE(val) ? _KH_IMMEDIATE_TYPE(val) : ((KhValue*) val)->type)
+#define KH_IS(val, t) (KH_VALUE_TYPE(val) == (KhValue*) (t))
+#define KH_IS_BASIC(val) (KH_BASIC_TYPE(KH_VALUE_TYPE(val)) < KH_NUM_BASIC_TYPES)
 #define KH_IS_NIL(val) KH_IS(val, KH_NIL_TYPE)
 #define KH_IS_INT(val) KH_IS(val, KH_INT_TYPE)
 #define KH_IS_STRING(val) KH_IS(val, KH_STRING_TYPE)
@@ -29,15 +49,24 @@ typedef enum {
 #define KH_IS_FUNC(val) KH_IS(val, KH_FUNC_TYPE)
 #define KH_IS_QUOTED(val) KH_IS(val, KH_QUOTED_TYPE)
 #define KH_IS_RECORD_TYPE(val) KH_IS(val, KH_RECORD_TYPE_TYPE)
+#define KH_IS_VECTOR(val) KH_IS(val, KH_VECTOR_TYPE)
+#define KH_IS_MAP(val) KH_IS(val, KH_MAP_TYPE)
+#define KH_IS_SEQ(val) KH_IS(val, KH_SEQ_TYPE)
 #define KH_IS_RECORD(val) (!KH_IS_BASIC(val) && KH_IS_RECORD_TYPE(val->type))
 
 #define _KH_CHECKED_CAST(val, t, struct_type) ({ assert(KH_IS(val, t)); (struct_type*) val; })
 #define KH_INT(val) _KH_CHECKED_CAST(val, KH_INT_TYPE, KhInt)
+// As an int may be either an immediate or a (large) heap-allocated `KhInt`, its value has to be
+// read through this rather than `KH_INT(val)->value`.
+#define KH_INT_VALUE(val) (KH_IS_IMMEDIATE(val) ? (assert(((long) (val)) & 1l), ((long) (val)) >> 1) : KH_INT(val)->value)
 #define KH_STRING(val) _KH_CHECKED_CAST(val, KH_STRING_TYPE, KhString)
 #define KH_CELL(val) _KH_CHECKED_CAST(val, KH_CELL_TYPE, KhCell)
 #define KH_SYMBOL(val) _KH_CHECKED_CAST(val, KH_SYMBOL_TYPE, KhSymbol)
 #define KH_FUNC(val) _KH_CHECKED_CAST(val, KH_FUNC_TYPE, KhFunc)
 #define KH_QUOTED(val) _KH_CHECKED_CAST(val, KH_QUOTED_TYPE, KhQuoted)
+#define KH_VECTOR(val) _KH_CHECKED_CAST(val, KH_VECTOR_TYPE, KhVector)
+#define KH_MAP(val) _KH_CHECKED_CAST(val, KH_MAP_TYPE, KhMap)
+#define KH_SEQ(val) _KH_CHECKED_CAST(val, KH_SEQ_TYPE, KhSeq)
 #define KH_RECORD_TYPE(val) _KH_CHECKED_CAST(val, KH_RECORD_TYPE_TYPE, KhRecordType)
 #define KH_RECORD(val) (assert(KH_IS_RECORD(val)), (KhRecord*) val)
 
@@ -65,16 +94,36 @@ typedef struct {
 	long value;
 } KhInt;
 
+// The backing storage for one or more strings. Strings are immutable, but a buffer may hold spare
+// capacity past its high-water mark, letting `kh_string_concat` extend the newest string in place
+// instead of copying everything; see there for the details.
+typedef struct {
+	char *data;
+	long used;
+	long capacity;
+} KhStringBuffer;
+
 typedef struct {
 	KhValue base;
 
+	// Always NUL-terminated, so existing C-string consumers keep working; `length` saves them a
+	// `strlen` when they care.
 	char *value;
+	long length;
+
+	// NULL for plain strings; set for strings that own (a prefix of) a shared buffer.
+	KhStringBuffer *buffer;
 } KhString;
 
 typedef struct {
 	KhValue base;
 
+	// Interned via `kh_intern`, so equal symbols share one pointer and `hash`/`id` (the name's
+	// content hash and its dense interner ID) are copied out of the interner at creation; nothing
+	// that touches a symbol ever has to re-hash the string.
 	const char *value;
+	unsigned int hash;
+	long id;
 } KhSymbol;
 
 typedef struct {
@@ -90,19 +139,60 @@ typedef struct {
 	KhValue *value;
 } KhQuoted;
 
+// Unlike the cons-cell lists Scarab code is made of, a vector is a contiguous array with O(1)
+// length and indexing, and amortized O(1) append (the backing array doubles as needed).
+typedef struct {
+	KhValue base;
+
+	long length;
+	long capacity;
+	KhValue **values;
+} KhVector;
+
 extern KhValue *kh_nil;
 
 // Other basic types (such as `KhFunc` or `KhRecordType`) are inspected less frequently, so they are
 // defined elsewhere and their actual struct definitions are hidden.
 
+// An arena for bulk cell allocation: cells are handed out bump-pointer style from large
+// GC-visible slabs, so building a big tree (as the parser does) costs one allocation per slab
+// rather than per cell, and cells end up adjacent in memory in traversal order. Individual cells
+// are freed only when the whole slab becomes unreachable, which is the right trade for ASTs.
+typedef struct _KhCellArena KhCellArena;
+
+KhCellArena* kh_cell_arena_new(long cells_per_slab);
+
 KhValue* kh_nil_new();
 KhValue* kh_int_new(long val);
 KhValue* kh_string_new(const char *val);
 KhValue* kh_string_new_take(char *val);
+KhValue* kh_string_new_len(const char *val, long length);
+// Returns the concatenation of two strings; amortized O(length of the right string) when the left
+// string was itself produced by concatenation.
+KhValue* kh_string_concat(KhString *left, KhString *right);
 KhValue* kh_symbol_new(const char *val);
 KhValue* kh_cell_new(KhValue *left, KhValue *right);
+// As `kh_cell_new`, but allocating from the given arena; a NULL arena falls back to a plain cell.
+KhValue* kh_cell_new_in(KhCellArena *arena, KhValue *left, KhValue *right);
 KhValue* kh_quoted_new(KhValue *val);
+KhValue* kh_vector_new(long capacity);
+void kh_vector_append(KhVector *vector, KhValue *val);
 
 char* kh_inspect(const KhValue *value);
 
+// # Inspection sinks
+//
+// `kh_inspect` renders into a heap string, which means a full in-memory copy of whatever is being
+// printed. A writer instead hands chunks to a callback as they are produced, so rendering a value
+// of any size needs O(1) extra memory.
+typedef struct {
+	void (*write)(const char *data, long length, void *userdata);
+	void *userdata;
+} KhWriter;
+
+// Returns a writer that appends to the given stdio stream.
+KhWriter kh_file_writer(FILE *file);
+
+void kh_inspect_to(const KhValue *value, KhWriter *writer);
+
 #endif